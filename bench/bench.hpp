@@ -0,0 +1,119 @@
+#ifndef __bench_hpp__
+#define __bench_hpp__
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A minimal benchmark harness: each case is run with a growing number of iterations until it lasts long enough,
+ * the results are printed as JSON on the standard output and as a table on the error output
+ */
+namespace Bench{
+
+	/**
+	 * @brief keep the compiler from removing a computation whose result is not used
+	 */
+	template<typename T>
+	inline void keep(const T& value){
+#if defined(__GNUC__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const T* sink;
+		sink = &value;
+#endif
+	}
+
+	/**
+	 * @brief A stream buffer dropping everything, to measure the formatting without the writing
+	 */
+	class NullBuffer : public std::streambuf{
+		protected:
+			int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+			std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+	};
+
+	using Params = std::vector<std::pair<std::string, long long>>;
+
+	struct Result{
+		std::string name;
+		Params params;
+		size_t iterations;
+		double ns_per_op;
+	};
+
+	class Suite{
+		private:
+			std::vector<Result> results;
+			std::string filter;
+			double min_time = 0.2; //seconds
+
+		public:
+			/**
+			 * @brief read the options: --filter <text> only runs the cases whose name contains the text, --min-time <seconds>
+			 */
+			Suite(int argc, char** argv){
+				for(int i = 1; i + 1 < argc; i += 2){
+					if(std::strcmp(argv[i], "--filter") == 0){
+						filter = argv[i+1];
+					}else if(std::strcmp(argv[i], "--min-time") == 0){
+						min_time = std::stod(argv[i+1]);
+					}
+				}
+			}
+
+			/**
+			 * @brief run a case
+			 * @param name: the name of the case
+			 * @param params: the parameters of the case, written with the result
+			 * @param body: a function running the measured operation n times, given n
+			 */
+			template<typename F>
+			void run(const std::string& name, const Params& params, F&& body){
+				if(!filter.empty() && name.find(filter) == std::string::npos){
+					return;
+				}
+				size_t iterations = 1;
+				double elapsed = 0;
+				while(true){
+					auto start = std::chrono::steady_clock::now();
+					body(iterations);
+					elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+					if(elapsed >= min_time || iterations >= (size_t(1) << 40)){
+						break;
+					}
+					//aim a bit over the minimal time, but never more than 10 times the iterations
+					double factor = elapsed > 0 ? min_time * 1.4 / elapsed : 10;
+					iterations = size_t(iterations * std::min(10.0, std::max(2.0, factor)));
+				}
+				results.push_back(Result{name, params, iterations, elapsed * 1e9 / iterations});
+				const Result& r = results.back();
+				std::cerr << r.name;
+				for(const auto& p : r.params){
+					std::cerr << ' ' << p.first << '=' << p.second;
+				}
+				std::cerr << ": " << r.ns_per_op << " ns/op (" << r.iterations << " iterations)" << std::endl;
+			}
+
+			/**
+			 * @brief write the results as JSON
+			 */
+			void write_json(std::ostream& os) const{
+				os << "{\"benchmarks\":[";
+				for(size_t i = 0; i < results.size(); ++i){
+					const Result& r = results[i];
+					os << (i ? ",\n" : "\n") << "{\"name\":\"" << r.name << "\",\"params\":{";
+					for(size_t k = 0; k < r.params.size(); ++k){
+						os << (k ? "," : "") << '"' << r.params[k].first << "\":" << r.params[k].second;
+					}
+					os << "},\"iterations\":" << r.iterations << ",\"ns_per_op\":" << r.ns_per_op << '}';
+				}
+				os << "\n]}" << std::endl;
+			}
+	};
+}
+
+#endif
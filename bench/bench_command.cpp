@@ -0,0 +1,262 @@
+/**
+ * @brief Benchmarks of the parsing, binding, dispatch, suggestion, help, mainloop and script paths of the CommandManager
+ * @note build it next to the library, for example:
+ *     g++ -O2 -std=c++17 -I.. bench_command.cpp ../command.cpp -o bench_command
+ *     ./bench_command [--filter <text>] [--min-time <seconds>] > results.json
+ */
+#include "command.hpp"
+#include "bench.hpp"
+
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace{
+	/**
+	 * @brief A command doing nothing, to measure what happens around Command::execute
+	 */
+	class Nop : public Command::Command{
+		public:
+			Nop(const std::string& name, const std::string& usage) : Command(name, "does nothing", "", usage) {}
+			void execute(const Kwargs& kwargs) override { Bench::keep(kwargs.size()); }
+	};
+
+	std::string usage_with(const std::string& name, size_t args){
+		std::string usage = name;
+		for(size_t i = 0; i < args; ++i){
+			usage += (i % 2 ? " [a" : " <a") + std::to_string(i) + (i % 2 ? "]" : ">");
+		}
+		return usage;
+	}
+
+	std::vector<std::string> random_names(size_t count, std::mt19937& rng){
+		std::vector<std::string> names(count);
+		for(size_t i = 0; i < count; ++i){
+			size_t length = 4 + rng() % 12;
+			for(size_t k = 0; k < length; ++k){
+				names[i] += char('a' + rng() % 26);
+			}
+			names[i] += std::to_string(i); //unique
+		}
+		return names;
+	}
+}
+
+int main(int argc, char** argv){
+	Bench::Suite suite(argc, argv);
+	Bench::NullBuffer null_buffer;
+	std::ostream null_out(&null_buffer);
+	std::istringstream no_input;
+	std::mt19937 rng(42);
+
+	//parsing, by number of arguments (each one is 8 characters) and of keyword arguments
+	for(long long args : {0, 4, 16, 64}){
+		for(long long kwargs : {0, 4, 16}){
+			std::string line = "command";
+			for(long long i = 0; i < args; ++i){
+				line += " argument";
+			}
+			for(long long i = 0; i < kwargs; ++i){
+				line += " key" + std::to_string(i) + "=value";
+			}
+			const Bench::Params params{{"args", args}, {"kwargs", kwargs}, {"length", (long long)line.size()}};
+			suite.run("parse/Input::parse", params, [&](size_t n){
+				for(size_t i = 0; i < n; ++i){
+					Bench::keep(Command::Input::parse(line));
+				}
+			});
+			Command::InputView view;
+			suite.run("parse/InputView::assign", params, [&](size_t n){
+				for(size_t i = 0; i < n; ++i){
+					view.assign(line);
+					Bench::keep(view);
+				}
+			});
+		}
+	}
+
+	//parsing of a long payload argument, bare or in double quotes with escapes
+	for(long long payload : {64, 1024, 16384}){
+		for(long long quoted : {0, 1}){
+			std::string text(payload, 'p');
+			for(long long i = 61; i < payload; i += 64){
+				text[i] = quoted ? '"' : '=';
+			}
+			std::string line = "command key=";
+			if(quoted){
+				line += '"';
+				for(char c : text){
+					if(c == '"'){
+						line += '\\';
+					}
+					line += c;
+				}
+				line += '"';
+			}else{
+				line += text;
+			}
+			const Bench::Params params{{"payload", payload}, {"quoted", quoted}, {"length", (long long)line.size()}};
+			Command::InputView view;
+			suite.run("parse/payload", params, [&](size_t n){
+				for(size_t i = 0; i < n; ++i){
+					view.assign(line);
+					Bench::keep(view);
+				}
+			});
+		}
+	}
+
+	//binding, by number of arguments of the command, given as arguments or as keyword arguments
+	for(long long args : {1, 2, 4, 8, 16, 32}){
+		Command::CommandManager manager("bench", no_input, null_out, null_out);
+		manager.disable_executable();
+		manager.addCommand(new Nop("nop", usage_with("nop", args)));
+		std::string positional = "nop", keywords = "nop";
+		for(long long i = 0; i < args; ++i){
+			positional += " value";
+			keywords += " a" + std::to_string(i) + "=value";
+		}
+		const Bench::Params params{{"args", args}};
+		Command::InputView by_position(positional), by_keyword(keywords);
+		suite.run("bind/positional", params, [&](size_t n){
+			for(size_t i = 0; i < n; ++i){
+				manager.execute(by_position);
+			}
+		});
+		suite.run("bind/keywords", params, [&](size_t n){
+			for(size_t i = 0; i < n; ++i){
+				manager.execute(by_keyword);
+			}
+		});
+	}
+
+	//dispatch and suggestions, by number of registered commands
+	for(long long count : {10, 100, 1000, 10000, 100000}){
+		Command::CommandManager manager("bench", no_input, null_out, null_out);
+		manager.disable_executable();
+		const std::vector<std::string> names = random_names(count, rng);
+		std::vector<Command::Command*> nops;
+		for(const std::string& name : names){
+			nops.push_back(new Nop(name, name));
+		}
+		manager.addCommands(nops);
+		std::vector<std::string> lookups;
+		for(size_t i = 0; i < 1024; ++i){
+			lookups.push_back(names[rng() % names.size()]);
+		}
+		const Bench::Params params{{"commands", count}};
+		suite.run("dispatch/getCommand", params, [&](size_t n){
+			for(size_t i = 0; i < n; ++i){
+				Bench::keep(manager.getCommand(lookups[i % lookups.size()]));
+			}
+		});
+		std::vector<Command::InputView> inputs;
+		for(const std::string& name : lookups){
+			inputs.emplace_back(name);
+		}
+		suite.run("dispatch/execute", params, [&](size_t n){
+			for(size_t i = 0; i < n; ++i){
+				manager.execute(inputs[i % inputs.size()]);
+			}
+		});
+
+		std::vector<std::string> typos;
+		for(size_t i = 0; i < 64; ++i){ //one substitution and one deletion
+			std::string typo = names[rng() % names.size()];
+			typo[rng() % typo.size()] = 'z';
+			typo.erase(rng() % typo.size(), 1);
+			typos.push_back(typo);
+		}
+		suite.run("similar/max2", params, [&](size_t n){
+			for(size_t i = 0; i < n; ++i){
+				Bench::keep(manager.similar(typos[i % typos.size()], 2));
+			}
+		});
+
+		suite.run("help/printHelp", params, [&](size_t n){
+			for(size_t i = 0; i < n; ++i){
+				manager.printHelp();
+			}
+		});
+	}
+
+	//running a command log through the mainloop, prompted line by line or as a batch
+	for(long long lines : {1024, 65536}){
+		std::string log;
+		for(long long i = 0; i < lines; ++i){
+			log += "nop value" + std::to_string(i) + " a1=" + std::to_string(i % 7) + '\n';
+		}
+		std::istringstream input(log);
+		Command::CommandManager manager("bench", input, null_out, null_out);
+		manager.disable_executable();
+		manager.addCommand(new Nop("nop", usage_with("nop", 2)));
+		for(long long batch : {0, 1}){
+			manager.setBatch(batch != 0);
+			const Bench::Params params{{"lines", lines}, {"batch", batch}};
+			suite.run("mainloop/log", params, [&](size_t n){
+				for(size_t i = 0; i < n; ++i){
+					input.clear();
+					input.seekg(0);
+					Bench::keep(manager.mainloop());
+				}
+			});
+		}
+	}
+
+	//running a script file, parsed line by line or loaded from the cache of the compiled scripts
+	for(long long lines : {1024, 65536}){
+		const fs::path directory = fs::temp_directory_path() / "bench_command_scripts";
+		fs::create_directories(directory);
+		const fs::path script = directory / ("script" + std::to_string(lines) + ".cmds");
+		{
+			std::ofstream file(script);
+			for(long long i = 0; i < lines; ++i){
+				file << "nop value" << i << " a1=" << i % 7 << '\n';
+			}
+		}
+		Command::CommandManager manager("bench", no_input, null_out, null_out);
+		manager.disable_executable();
+		manager.addCommand(new Nop("nop", usage_with("nop", 2)));
+		for(long long cached : {0, 1}){
+			if(cached){
+				manager.enableScriptCache(directory / "cache");
+			}
+			const Bench::Params params{{"lines", lines}, {"cached", cached}};
+			suite.run("script/execute_script", params, [&](size_t n){
+				for(size_t i = 0; i < n; ++i){
+					manager.execute_script(script);
+				}
+			});
+		}
+		fs::remove_all(directory);
+	}
+
+	//a loop of a script, against the same lines written out one by one
+	for(long long iterations : {1024, 65536}){
+		const fs::path directory = fs::temp_directory_path() / "bench_command_loops";
+		fs::create_directories(directory);
+		const fs::path unrolled = directory / "unrolled.cmds", loop = directory / "loop.cmds";
+		{
+			std::ofstream file(unrolled);
+			for(long long i = 1; i <= iterations; ++i){
+				file << "nop value" << i << " a1=3\n";
+			}
+			std::ofstream(loop) << "for i from 1 to " << iterations << "\n\tnop value$i a1=3\nend\n";
+		}
+		Command::CommandManager manager("bench", no_input, null_out, null_out);
+		manager.disable_executable();
+		manager.addCommand(new Nop("nop", usage_with("nop", 2)));
+		for(long long looped : {0, 1}){
+			const Bench::Params params{{"iterations", iterations}, {"loop", looped}};
+			suite.run("script/loop", params, [&](size_t n){
+				for(size_t i = 0; i < n; ++i){
+					manager.execute_script(looped ? loop : unrolled);
+				}
+			});
+		}
+		fs::remove_all(directory);
+	}
+
+	suite.write_json(std::cout);
+	return 0;
+}
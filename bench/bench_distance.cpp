@@ -0,0 +1,65 @@
+/**
+ * @brief Benchmark of the edit distance kernels behind CommandManager::similar
+ * @note build it next to the library, for example:
+ *     g++ -O2 -std=c++17 -I.. bench_distance.cpp ../command.cpp -o bench_distance
+ */
+#include "command.hpp"
+#include "bench.hpp"
+
+#include <random>
+
+namespace{
+	std::vector<std::string> random_names(size_t count, size_t max_length, std::mt19937& rng){
+		std::vector<std::string> names(count);
+		for(std::string& name : names){
+			size_t length = 3 + rng() % (max_length - 2);
+			for(size_t i = 0; i < length; ++i){
+				name += char('a' + rng() % 26);
+			}
+		}
+		return names;
+	}
+}
+
+int main(int argc, char** argv){
+	Bench::Suite suite(argc, argv);
+	std::mt19937 rng(42);
+	const std::vector<std::string> names = random_names(10000, 24, rng);
+	const std::string query = random_names(1, 24, rng)[0];
+	std::vector<std::string_view> views(names.begin(), names.end());
+	const Bench::Params params{{"names", (long long)names.size()}};
+
+	//each operation is the comparison of the query against all the names
+	suite.run("distance/Utility::difference", params, [&](size_t n){
+		for(size_t i = 0; i < n; ++i){
+			for(const std::string& name : names){
+				Bench::keep(difference(query, name));
+			}
+		}
+	});
+	suite.run("distance/edit_distance", params, [&](size_t n){
+		for(size_t i = 0; i < n; ++i){
+			for(const std::string& name : names){
+				Bench::keep(Command::edit_distance(query, name));
+			}
+		}
+	});
+	suite.run("distance/EditDistance", params, [&](size_t n){
+		const Command::EditDistance distance(query);
+		for(size_t i = 0; i < n; ++i){
+			for(std::string_view name : views){
+				Bench::keep(distance(name));
+			}
+		}
+	});
+	suite.run("distance/EditDistance_batch", params, [&](size_t n){
+		const Command::EditDistance distance(query);
+		std::vector<size_t> distances(views.size());
+		for(size_t i = 0; i < n; ++i){
+			distance(views.data(), views.size(), distances.data());
+			Bench::keep(distances[0]);
+		}
+	});
+	suite.write_json(std::cout);
+	return 0;
+}
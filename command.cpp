@@ -1,5 +1,35 @@
 #include "command.hpp"
 
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#else
+#include <process.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 
 class depth_recursion_error : public std::exception{
 	private:
@@ -105,355 +135,4682 @@ namespace Command{ //Command::Input class implementation
 		}
 
 		Input Input::parse(const std::string& s){
-			Input cmd;
-			std::vector<std::string> tokens = split(s, ' ');
-			cmd.command = tokens[0];
-			for(int i = 1; size_t(i) < tokens.size(); i++){
-				cmd.raw_args += tokens[i] + " ";
-				if(tokens[i].find('=') != std::string::npos){
-					std::vector<std::string> kv = split(tokens[i], '=');
-					cmd.kwargs[kv[0]] = kv[1];
-				}else{
-					cmd.args.push_back(tokens[i]);
-				}
-			}
-			return cmd;
+			return InputView(s).toInput();
 		}
 
 		Input Input::parse(const char* s){
-			return parse(std::string(s));
+			return InputView(s).toInput();
 		}
 }
 
-namespace Command{ //Command::Command class implementation
+namespace{ //the classification of the bytes of a line, for the tokenizer of InputView
 
+	/**
+	 * @brief The classes of the bytes the tokenizer looks for, combined as flags
+	 */
+	enum ByteClass : uint8_t{
+		Space = 1,
+		SingleQuote = 2,
+		DoubleQuote = 4,
+		Backslash = 8,
+		Equal = 16
+	};
 
-	Command::Command(const std::string& _name, const std::string& _description, const std::vector<std::string>& long_desc, const std::string& _usage)
-		: name(_name), description(_description), long_description(long_desc), usage(_usage){
-		parse_usage();
-	}
+	/**
+	 * @brief The classes of the bytes of a block of the line, one bit per byte
+	 */
+	struct ByteClasses{
+		uint32_t space, single_quote, double_quote, backslash, equal;
+		/**
+		 * @brief the bytes of the block which are in the line (the last block is shorter)
+		 */
+		uint32_t valid;
 
-	Command::Command(const std::string& _name)
-		: name(_name), description(""), usage(_name){
+		/**
+		 * @brief the bytes of the block which are in one of the classes
+		 */
+		template<uint8_t Classes>
+		inline uint32_t select() const{
+			return ((Classes & Space ? space : 0) | (Classes & SingleQuote ? single_quote : 0) | (Classes & DoubleQuote ? double_quote : 0)
+			        | (Classes & Backslash ? backslash : 0) | (Classes & Equal ? equal : 0)) & valid;
+		}
+	};
+	constexpr size_t block_size = 32;
+
+	inline bool is_blank(char c){
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
 	}
 
-	Command::Command(const char* _name, const char* _description, const char** long_desc, const size_t& long_desc_size, const char* _usage)
-		: name(_name), description(_description), usage(_usage){
-		for(size_t i = 0; i < long_desc_size; i++){
-			long_description.push_back(long_desc[i]);
+	void classify_bytes(const char* p, ByteClasses& c, size_t count){
+		c.space = c.single_quote = c.double_quote = c.backslash = c.equal = 0;
+		for(size_t k = 0; k < count; ++k){
+			const uint32_t bit = uint32_t(1) << k;
+			switch(p[k]){
+				case ' ': case '\t': case '\r': case '\n': c.space |= bit; break;
+				case '\'': c.single_quote |= bit; break;
+				case '"': c.double_quote |= bit; break;
+				case '\\': c.backslash |= bit; break;
+				case '=': c.equal |= bit; break;
+				default: break;
+			}
 		}
-		parse_usage();
 	}
 
-	Command::Command(const std::string& _name, const std::string& _description, const std::string& long_desc, const std::string& _usage)
-		: name(_name), description(_description), long_description(split(long_desc, '\n')), usage(_usage){
-		parse_usage();
-	}
-	Command::Command(const char* _name, const char* _description, const char* long_desc, const char* _usage)
-		: name(_name), description(_description), long_description(split(long_desc, '\n')), usage(_usage){
-		parse_usage();
-	}
-	
-	Command::Command(const char* _name)
-		: name(_name), description(""), usage(_name){
+	void classify_scalar(const char* p, ByteClasses& c){
+		classify_bytes(p, c, block_size);
 	}
 
-	Command::Command(const Command& c)
-		: name(c.name), description(c.description), usage(c.usage){
-			master = nullptr;
+	/**
+	 * @brief the first block from block which has a byte of the classes, or the last (shorter) block, or size
+	 */
+	size_t skip_scalar(const char* data, size_t block, size_t size, uint8_t classes){
+		ByteClasses c;
+		for(; size - block >= block_size; block += block_size){
+			classify_scalar(data + block, c);
+			const uint32_t mask = ((classes & Space) ? c.space : 0) | ((classes & SingleQuote) ? c.single_quote : 0) | ((classes & DoubleQuote) ? c.double_quote : 0)
+			                      | ((classes & Backslash) ? c.backslash : 0) | ((classes & Equal) ? c.equal : 0);
+			if(mask != 0){
+				break;
+			}
+		}
+		return block;
 	}
 
-	Command::~Command(){
+	/**
+	 * @brief true if the line has no quote, no backslash and no blank but ' ': it's split on the spaces alone
+	 */
+	bool plain_scalar(const char* data, size_t size){
+		for(size_t k = 0; k < size; ++k){
+			switch(data[k]){
+				case '\t': case '\r': case '\n': case '\'': case '"': case '\\': return false;
+				default: break;
+			}
+		}
+		return true;
 	}
 
-	void Command::setName(const std::string& name){
-		master->removeCommand(this);
-		this->name = name;
-		master->addCommand(this);
+#if defined(__GNUC__) && defined(__x86_64__)
+#define COMMAND_HAS_SIMD_TOKENIZER 1
+	__attribute__((target("sse2")))
+	inline uint32_t match_sse2(__m128i v, char ch){
+		return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(ch)));
+	}
+	__attribute__((target("sse2")))
+	void classify_sse2(const char* p, ByteClasses& c){
+		c.space = c.single_quote = c.double_quote = c.backslash = c.equal = 0;
+		for(int half = 0; half < 2; ++half){ //two blocks of 16 bytes
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * half));
+			const int shift = 16 * half;
+			c.space |= (match_sse2(v, ' ') | match_sse2(v, '\t') | match_sse2(v, '\r') | match_sse2(v, '\n')) << shift;
+			c.single_quote |= match_sse2(v, '\'') << shift;
+			c.double_quote |= match_sse2(v, '"') << shift;
+			c.backslash |= match_sse2(v, '\\') << shift;
+			c.equal |= match_sse2(v, '=') << shift;
+		}
 	}
 
-	//count the number of required arguments (in <>) and optional arguments (in [])
-	void Command::parse_usage(){
-		std::vector<std::string> tokens = split(usage, ' ');
-		tokens.erase(tokens.begin()); //the first token is the command name
-		for(auto t : tokens){			
-			if(t == "[args...]"){
-				//the user can pass any number of arguments, and their keyes will be the position in the list (in optional_args)
-				//this is a special case, so we handle it here
-				optional_args.push_back("args...");
-				set_default_value("args...", "");
-				args_ordered.push_back("args...");
-				//if they are remaining arguments, they will be ignored
-				break; //we don't need to parse the rest of the usage string
+	/**
+	 * @brief the bytes of v which are in the classes enabled by the masks (all ones or zero)
+	 */
+	__attribute__((target("sse2")))
+	inline __m128i hits_sse2(__m128i v, __m128i space, __m128i single_quote, __m128i double_quote, __m128i backslash, __m128i equal){
+		auto eq = [v](char ch){ return _mm_cmpeq_epi8(v, _mm_set1_epi8(ch)); };
+		__m128i hits = _mm_and_si128(space, _mm_or_si128(_mm_or_si128(eq(' '), eq('\t')), _mm_or_si128(eq('\r'), eq('\n'))));
+		hits = _mm_or_si128(hits, _mm_and_si128(single_quote, eq('\'')));
+		hits = _mm_or_si128(hits, _mm_and_si128(double_quote, eq('"')));
+		hits = _mm_or_si128(hits, _mm_and_si128(backslash, eq('\\')));
+		return _mm_or_si128(hits, _mm_and_si128(equal, eq('=')));
+	}
+	__attribute__((target("sse2")))
+	size_t skip_sse2(const char* data, size_t block, size_t size, uint8_t classes){
+		auto enabled = [classes](uint8_t c){ return _mm_set1_epi8((classes & c) != 0 ? char(-1) : char(0)); };
+		const __m128i space = enabled(Space), single_quote = enabled(SingleQuote), double_quote = enabled(DoubleQuote);
+		const __m128i backslash = enabled(Backslash), equal = enabled(Equal);
+		for(; size - block >= block_size; block += block_size){
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + block));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + block + 16));
+			const __m128i hits = _mm_or_si128(hits_sse2(a, space, single_quote, double_quote, backslash, equal), hits_sse2(b, space, single_quote, double_quote, backslash, equal));
+			if(_mm_movemask_epi8(hits) != 0){
+				break;
 			}
-			if(t[0] == '[' && t[t.size()-1] == ']'){
-				optional_args.push_back(t.substr(1, t.size()-2));
-				set_default_value(t.substr(1, t.size()-2), "");
-				args_ordered.push_back(t.substr(1, t.size()-2));
-			}else if(t[0] == '<' && t[t.size()-1] == '>'){
-				required_args.push_back(t.substr(1, t.size()-2));
-				args_ordered.push_back(t.substr(1, t.size()-2));
-			}else{
-				std::cout << "Invalid usage string: " << usage << std::endl;
+		}
+		return block;
+	}
+	__attribute__((target("sse2")))
+	bool plain_sse2(const char* data, size_t size){
+		size_t k = 0;
+		for(; size - k >= 16; k += 16){
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + k));
+			auto eq = [v](char ch){ return _mm_cmpeq_epi8(v, _mm_set1_epi8(ch)); };
+			const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_or_si128(eq('\t'), eq('\r')), _mm_or_si128(eq('\n'), eq('\''))), _mm_or_si128(eq('"'), eq('\\')));
+			if(_mm_movemask_epi8(hits) != 0){
+				return false;
 			}
 		}
+		return plain_scalar(data + k, size - k);
 	}
 
-	void Command::set_default_value(const std::string& arg, const std::string& value){
-		default_values[arg] = value;
+	__attribute__((target("avx2")))
+	inline __m256i load_avx2(const char* p){
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
 	}
-	void Command::set_default_value(const char* arg, const char* value){
-		default_values[arg] = value;
+	__attribute__((target("avx2")))
+	inline uint32_t match_avx2(__m256i v, char ch){
+		return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch)));
+	}
+	__attribute__((target("avx2")))
+	void classify_avx2(const char* p, ByteClasses& c){
+		const __m256i v = load_avx2(p);
+		c.space = match_avx2(v, ' ') | match_avx2(v, '\t') | match_avx2(v, '\r') | match_avx2(v, '\n');
+		c.single_quote = match_avx2(v, '\'');
+		c.double_quote = match_avx2(v, '"');
+		c.backslash = match_avx2(v, '\\');
+		c.equal = match_avx2(v, '=');
 	}
 
-	char Command::is_argument(const std::string& arg) const{
-		if(std::find(required_args.begin(), required_args.end(), arg) != required_args.end()){
-			return 1;
-		}else if(std::find(optional_args.begin(), optional_args.end(), arg) != optional_args.end()){
-			return 2;
-		}else{
-			return 0;
+	/**
+	 * @brief the bytes of v which are in the wanted classes: each byte gets the bits of its classes from the tables of its two nibbles
+	 * @note the bits: 1 tab/\n/\r, 2 ' ', 4 '"', 8 '\'', 16 '=', 32 '\\'; a table row of a class shares no bit with the rows of the others
+	 */
+	__attribute__((target("avx2")))
+	inline __m256i hits_avx2(__m256i v, __m256i wanted){
+		const __m256i low = _mm256_setr_epi8(2, 0, 4, 0, 0, 0, 0, 8, 0, 1, 1, 0, 32, 1 | 16, 0, 0,
+		                                     2, 0, 4, 0, 0, 0, 0, 8, 0, 1, 1, 0, 32, 1 | 16, 0, 0);
+		const __m256i high = _mm256_setr_epi8(1, 0, 2 | 4 | 8, 16, 0, 32, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		                                      1, 0, 2 | 4 | 8, 16, 0, 32, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m256i nibble = _mm256_set1_epi8(0x0f);
+		const __m256i bits = _mm256_and_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(v, nibble)),
+		                                      _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+		return _mm256_and_si256(bits, wanted);
+	}
+	__attribute__((target("avx2")))
+	size_t skip_avx2(const char* data, size_t block, size_t size, uint8_t classes){
+		const char bits = char(((classes & Space) ? 1 | 2 : 0) | ((classes & DoubleQuote) ? 4 : 0) | ((classes & SingleQuote) ? 8 : 0)
+		                       | ((classes & Equal) ? 16 : 0) | ((classes & Backslash) ? 32 : 0));
+		const __m256i wanted = _mm256_set1_epi8(bits);
+		for(; size - block >= 2 * block_size; block += 2 * block_size){ //two blocks at a time
+			const __m256i a = hits_avx2(load_avx2(data + block), wanted);
+			const __m256i b = hits_avx2(load_avx2(data + block + block_size), wanted);
+			const __m256i hits = _mm256_or_si256(a, b);
+			if(!_mm256_testz_si256(hits, hits)){
+				return _mm256_testz_si256(a, a) ? block + block_size : block;
+			}
+		}
+		if(size - block >= block_size){
+			const __m256i a = hits_avx2(load_avx2(data + block), wanted);
+			if(_mm256_testz_si256(a, a)){
+				block += block_size;
+			}
 		}
+		return block;
 	}
-
-}
-
-namespace Command{ //Command::CommandManager class implementation
-
-	CommandManager::CommandManager(std::string _name, std::istream& _in, std::ostream& _out, std::ostream& _err)
-		: in(_in), out(_out), err(_err), name(_name){
+	/**
+	 * @brief the bytes of v which may make a line not plain: the control bytes, the quotes (and '#', '&', which share their bits) and '\\'
+	 * @note it's cheaper than the tables of hits_avx2, and a byte wrongly taken only sends the line to the scanner
+	 */
+	__attribute__((target("avx2")))
+	inline __m256i unplain_avx2(__m256i v){
+		const __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v);
+		const __m256i quote = _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x05)), _mm256_set1_epi8('\''));
+		return _mm256_or_si256(_mm256_or_si256(control, quote), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
 	}
-	CommandManager::~CommandManager(){
-		for(auto it = commands.begin(); it != commands.end(); it++){
-			delete it->second;
+	__attribute__((target("avx2")))
+	bool plain_avx2(const char* data, size_t size){
+		size_t k = 0;
+		for(; size - k >= 4 * block_size; k += 4 * block_size){ //four blocks at a time
+			const __m256i hits = _mm256_or_si256(_mm256_or_si256(unplain_avx2(load_avx2(data + k)), unplain_avx2(load_avx2(data + k + block_size))),
+			                                     _mm256_or_si256(unplain_avx2(load_avx2(data + k + 2 * block_size)), unplain_avx2(load_avx2(data + k + 3 * block_size))));
+			if(!_mm256_testz_si256(hits, hits)){
+				return false;
+			}
 		}
+		return plain_sse2(data + k, size - k);
 	}
+#endif
 
+	using Classifier = void (*)(const char*, ByteClasses&);
+	using Skipper = size_t (*)(const char*, size_t, size_t, uint8_t);
+	using PlainTest = bool (*)(const char*, size_t);
 
-	std::string CommandManager::parse_question(){
-		std::string question = this->question;
-		size_t pos = question.find("%name");
-		while(pos != std::string::npos){
-			question.replace(pos, 5, name);
-			pos = question.find("%name");
-		}
-		return question;
+	/**
+	 * @brief The kernels of the widest instruction set of the CPU
+	 */
+	struct Kernels{
+		Classifier classify;
+		Skipper skip;
+		PlainTest plain;
+	};
+
+	/**
+	 * @brief the kernels of the CPU, chosen once (a line can be parsed by the constructor of a global, so it's not a global)
+	 */
+	const Kernels& kernels(){
+		static const Kernels chosen = []{
+#ifdef COMMAND_HAS_SIMD_TOKENIZER
+			__builtin_cpu_init();
+			if(__builtin_cpu_supports("avx2")){
+				return Kernels{classify_avx2, skip_avx2, plain_avx2};
+			}
+			if(__builtin_cpu_supports("sse2")){
+				return Kernels{classify_sse2, skip_sse2, plain_sse2};
+			}
+#endif
+			return Kernels{classify_scalar, skip_scalar, plain_scalar};
+		}();
+		return chosen;
 	}
 
+	/**
+	 * @brief Walks a line block by block, finding the next byte of some classes with the bit masks of its block
+	 * @note a run of blocks without any of the bytes looked for (a long payload) is skipped without classifying its blocks
+	 */
+	class ByteScanner{
+		private:
+			const char* data;
+			size_t size;
+			const Kernels& kernel = kernels();
+			size_t base = size_t(-1);
+			ByteClasses classes;
 
-	void CommandManager::addCommand(Command* c){
-		if(this == c->master) return;
-		commands[c->name] = c;
-		c->master = this;
-	}
-	void CommandManager::removeCommand(const std::string& name){
-		commands[name]->master = nullptr;
-		commands.erase(name);
-	}
-	void CommandManager::removeCommand(const char* name){
-		commands[name]->master = nullptr;
-		commands.erase(name);
-	}
-	void CommandManager::removeCommand(Command* c){
-		c->master = nullptr;
-		commands.erase(c->name);
-	}
+			void load(size_t block){
+				base = block;
+				if(size - block >= block_size){
+					kernel.classify(data + block, classes);
+					classes.valid = ~uint32_t(0);
+				}else{ //the last block is classified byte by byte, so nothing is read after the line
+					classify_bytes(data + block, classes, size - block);
+					classes.valid = (uint32_t(1) << (size - block)) - 1;
+				}
+			}
 
+		public:
+			ByteScanner(std::string_view s) : data(s.data()), size(s.size()) {}
 
-	std::vector<std::string> CommandManager::similar(const std::string& name,unsigned int max) const{
-		std::vector<std::string> similar;
-		for(auto it = commands.begin(); it != commands.end(); it++){
-			if(difference(it->first, name) <= max){
-				similar.push_back(it->first);
+			/**
+			 * @brief the position of the next byte (from i) of one of the classes, or the size of the line
+			 */
+			template<uint8_t Wanted>
+			size_t next(size_t i){
+				while(i < size){
+					size_t block = i & ~(block_size - 1);
+					if(block != base){
+						load(block);
+					}
+					const uint32_t mask = classes.select<Wanted>() & (~uint32_t(0) << (i - block));
+					if(mask != 0){
+						return block + __builtin_ctz(mask);
+					}
+					block += block_size;
+					if(block < size && size - block >= block_size){
+						block = kernel.skip(data, block, size, Wanted);
+					}
+					i = block;
+				}
+				return size;
+			}
+
+			/**
+			 * @brief the position of the next byte (from i) which is not blank, or the size of the line
+			 */
+			size_t next_not_blank(size_t i){
+				while(i < size){
+					const size_t block = i & ~(block_size - 1);
+					if(block != base){
+						load(block);
+					}
+					const uint32_t mask = ~classes.space & classes.valid & (~uint32_t(0) << (i - block));
+					if(mask != 0){
+						return block + __builtin_ctz(mask);
+					}
+					i = block + block_size;
+				}
+				return size;
 			}
+	};
+}
+
+namespace Command{ //Command::InputView class implementation
+		InputView::InputView(std::string_view s){
+			assign(s);
 		}
-		return similar;
-	}
 
+		InputView::InputView(const Input& i)
+			: command(i.command), raw_args(i.raw_args){
+			args.reserve(i.args.size());
+			for(const std::string& arg : i.args){
+				args.push_back(arg);
+			}
+			kwargs.reserve(i.kwargs.size());
+			for(const auto& kwarg : i.kwargs){
+				kwargs.emplace_back(kwarg.first, kwarg.second);
+			}
+		}
 
-	void CommandManager::execute(Input i){
-		if(i.name() == ""){
-			return;
+		InputView::InputView(const InputView& i)
+			: command(i.command), args(i.args), kwargs(i.kwargs), raw_args(i.raw_args), arena(i.arena){
+			rebase(i.arena.data(), i.arena.size());
+		}
+
+		InputView::InputView(InputView&& i) noexcept
+			: command(i.command), args(std::move(i.args)), kwargs(std::move(i.kwargs)), raw_args(i.raw_args){
+			const char* from = i.arena.data();
+			const size_t size = i.arena.size();
+			arena = std::move(i.arena); //a short arena is copied, not moved
+			rebase(from, size);
 		}
-		if(commands.find(i.name()) != commands.end()){ //the command exists
-			::Command::Command* cmd = commands[i.name()]; //get the command
-			std::vector<std::string> missing = cmd->required_args; //get the required arguments
-			std::vector<std::string> missings_optional = cmd->optional_args; //get the optional arguments
-			Command::Command::Kwargs kwargs;
 
-			for(auto kwarg : i.getKwargs()){ //set the default values
-			std::string key = kwarg.first, value = kwarg.second;
-				if(cmd->is_argument(key) > 0){ //the kwargs is ok
-					kwargs[key] = value;
-					missing.erase(std::remove(missing.begin(), missing.end(), key), missing.end());
-					missings_optional.erase(std::remove(missings_optional.begin(), missings_optional.end(), key), missings_optional.end());
+		InputView& InputView::operator=(const InputView& i){
+			if(this != &i){
+				command = i.command;
+				args = i.args;
+				kwargs = i.kwargs;
+				raw_args = i.raw_args;
+				arena.assign(i.arena);
+				rebase(i.arena.data(), i.arena.size());
+			}
+			return *this;
+		}
 
-				}else{ //the kwargs is not ok
-					print("Command '" + i.name() + "' does not have an argument '" + key + "'. Ingoring it.");
-				}
+		InputView& InputView::operator=(InputView&& i) noexcept{
+			if(this != &i){
+				command = i.command;
+				args = std::move(i.args);
+				kwargs = std::move(i.kwargs);
+				raw_args = i.raw_args;
+				const char* from = i.arena.data();
+				const size_t size = i.arena.size();
+				arena = std::move(i.arena);
+				rebase(from, size);
 			}
-			//here, we've parsed only the kwargs, now we parse the args
+			return *this;
+		}
 
-			for(size_t j = 0; j < missing.size(); ++j){// get missings arguments from the input
-				if(j < i.getArgs().size()){ //if there is enough arguments
-					kwargs[cmd->args_ordered[j]] = i.getArgs()[j];
-				}else{
-					throw CommandException("Command '" + i.name() + "' required argument '" + cmd->args_ordered[j] + "' is missing.");
-				}
+		void InputView::rebase(const char* from, size_t size){
+			if(from == arena.data()){
+				return;
 			}
-			for(size_t j = 0; j < missings_optional.size(); ++j){// get missings optional arguments from the input
-				if(j < i.getArgs().size()){
-					kwargs[cmd->args_ordered[j]] = i.getArgs()[j];
-				}else{
-					break; //if there is no more arguments, we stop
+			auto move = [this, from, size](std::string_view& v){
+				if(v.data() >= from && v.data() + v.size() <= from + size && v.data() != nullptr){
+					v = std::string_view(arena.data() + (v.data() - from), v.size());
 				}
+			};
+			move(command);
+			for(std::string_view& arg : args){
+				move(arg);
 			}
-			//here, we parsed the gived arguments, so now, if all are good, we only have optional arguments to parse
+			for(Kwarg& kwarg : kwargs){
+				move(kwarg.first);
+				move(kwarg.second);
+			}
+		}
 
-			for(auto arg : cmd->optional_args){ // set the default values for the optional arguments
-				if(kwargs.find(arg) == kwargs.end()){
-					if(cmd->default_values.find(arg) != cmd->default_values.end()){
-						kwargs[arg] = cmd->default_values[arg];
+		void InputView::clear(){
+			command = std::string_view();
+			raw_args = std::string_view();
+			args.clear();
+			kwargs.clear();
+			arena.clear();
+		}
+
+		void InputView::assign(std::string_view s){
+			clear();
+			const char* data = s.data();
+			const size_t n = s.size();
+			if(kernels().plain(data, n)){ //nothing to unescape: the tokens are found with memchr, which is faster than the scanner on short tokens
+				auto skip_spaces = [data, n](size_t i){
+					while(i < n && data[i] == ' '){
+						++i;
+					}
+					return i;
+				};
+				size_t i = skip_spaces(0);
+				bool first = true;
+				while(i < n){
+					const size_t end = std::min(s.find(' ', i), n);
+					std::string_view token = s.substr(i, end - i);
+					if(first){
+						command = token;
+						first = false;
 					}else{
-						throw CommandException("Command '" + i.name() + "' required argument '" + arg + "' does not have a default value.");
+						if(raw_args.data() == nullptr){
+							raw_args = s.substr(i);
+						}
+						const size_t eq = token.find('=');
+						if(eq != std::string_view::npos){
+							kwargs.emplace_back(token.substr(0, eq), token.substr(eq + 1));
+						}else{
+							args.push_back(token);
+						}
 					}
+					i = skip_spaces(end);
 				}
+				return;
 			}
-			
-			//if there is more arguments than the command can handle, we print an error
-			if(i.getArgCount() + i.getKwargCount() > cmd->args_ordered.size()){
-				std::string msg = "Command '" + i.name() + "' has too many arguments. ";
-				msg += "The command can handle " + std::to_string(cmd->args_ordered.size()) + " arguments, but " + std::to_string(i.getArgCount()+i.getKwargCount()) + " were given.";
-				throw CommandException(msg);
-			}
+			arena.reserve(n); //a token is never longer once unescaped, so the arena never moves
+			ByteScanner scanner(s);
 
-			cmd->execute(kwargs);
+			//the field being read (the token, or the key then the value of a keyword argument): a view of the line
+			//until a quote or an escape, then a copy in the arena; span is the start of what is not copied yet
+			size_t field = 0, span = 0, arena_start = 0;
+			bool in_arena = false;
+			bool first = true, has_key = false;
+			std::string_view key;
 
+			auto copy_span = [&](size_t end){
+				if(!in_arena){
+					in_arena = true;
+					arena_start = arena.size();
+				}
+				arena.append(data + span, end - span);
+			};
+			auto begin_field = [&](size_t pos){
+				field = span = pos;
+				in_arena = false;
+			};
+			auto end_field = [&](size_t end){
+				if(!in_arena){
+					return s.substr(field, end - field);
+				}
+				arena.append(data + span, end - span);
+				return std::string_view(arena.data() + arena_start, arena.size() - arena_start);
+			};
 
-		}
-		else if(allow_execution){
-			try{
-				execute_file(i.name(), i.getArgs());
-			}catch(CommandException& e){
-				err << e.what() << std::endl;
+			size_t i = 0;
+			while(true){
+				i = scanner.next_not_blank(i);
+				if(i == n){
+					break;
+				}
+				if(!first && raw_args.data() == nullptr){
+					raw_args = s.substr(i);
+				}
+				begin_field(i);
+				while(true){ //the token
+					constexpr uint8_t special = Space | SingleQuote | DoubleQuote | Backslash;
+					const size_t j = first || has_key ? scanner.next<special>(i) : scanner.next<special | Equal>(i); //only the first '=' of an argument splits it
+					if(j == n || is_blank(data[j])){
+						std::string_view value = end_field(j);
+						if(first){
+							command = value;
+							first = false;
+						}else if(has_key){
+							kwargs.emplace_back(key, value);
+						}else{
+							args.push_back(value);
+						}
+						has_key = false;
+						i = j;
+						break;
+					}
+					switch(data[j]){
+						case '=':
+							key = end_field(j);
+							has_key = true;
+							begin_field(j + 1);
+							i = j + 1;
+							break;
+						case '\\':
+							if(j + 1 == n){ //nothing to escape, it's kept
+								i = n;
+								break;
+							}
+							copy_span(j);
+							span = j + 1; //the escaped character is copied with what follows
+							i = j + 2;
+							break;
+						case '\'':{
+							copy_span(j);
+							const size_t close = scanner.next<SingleQuote>(j + 1);
+							arena.append(data + j + 1, close - j - 1);
+							i = span = std::min(close + 1, n);
+							break;
+						}
+						default:{ //'"'
+							copy_span(j);
+							span = j + 1;
+							size_t k = j + 1;
+							while((k = scanner.next<DoubleQuote | Backslash>(k)) < n && data[k] == '\\'){
+								if(k + 1 < n && (data[k + 1] == '"' || data[k + 1] == '\\')){
+									arena.append(data + span, k - span);
+									span = k + 1;
+									k += 2;
+								}else{ //any other backslash is kept
+									k += 1;
+								}
+							}
+							arena.append(data + span, std::min(k, n) - span);
+							i = span = std::min(k + 1, n);
+							break;
+						}
+					}
+				}
 			}
 		}
-		else{ // if the command does not exist
-			std::vector<std::string> similar = this->similar(i.name(), 2);
-			std::string msg = "Command '" + i.name() + "' not found.";
-			if(similar.size() > 0){
-				msg += " Did you mean " + similar[0] + " ?";
+
+		size_t InputView::find_unquoted(std::string_view s, char c, size_t from){
+			if(s.find_first_of("'\"\\", from) == std::string_view::npos){ //nothing is quoted
+				return s.find(c, from);
+			}
+			for(size_t i = from; i < s.size(); ++i){
+				const char ch = s[i];
+				if(ch == c){
+					return i;
+				}
+				if(ch == '\\'){
+					++i;
+				}else if(ch == '\''){
+					i = std::min(s.find('\'', i + 1), s.size());
+				}else if(ch == '"'){
+					for(++i; i < s.size() && s[i] != '"'; ++i){
+						if(s[i] == '\\' && i + 1 < s.size() && (s[i + 1] == '"' || s[i + 1] == '\\')){
+							++i;
+						}
+					}
+				}
 			}
-			print(msg);
+			return std::string_view::npos;
 		}
-	}
-	void CommandManager::execute(const std::string& s){
-		execute(Input::parse(s));
-	}
-	void CommandManager::execute(const char* s){
-		execute(Input::parse(s));
-	}
 
-	void CommandManager::execute_file(const fs::path& executable, const std::vector<std::string>& args){
-		if(fs::exists(executable)){
-			if(fs::is_regular_file(executable)){
-				std::string cmd = executable.string();
-				for(auto arg : args){
-					cmd += " " + arg;
+		std::string_view InputView::operator[](std::string_view key) const{
+			for(auto it = kwargs.rbegin(); it != kwargs.rend(); it++){ //the last given value wins
+				if(it->first == key){
+					return it->second;
 				}
-				int res = system(cmd.c_str());
-				if(res != 0){
-					throw CommandException("The file '" + executable.string() + "' returned an error code.");
+			}
+			throw std::out_of_range("InputView: no keyword argument '" + std::string(key) + "'");
+		}
+
+		bool InputView::hasKwarg(std::string_view key) const{
+			for(const Kwarg& kwarg : kwargs){
+				if(kwarg.first == key){
+					return true;
 				}
 			}
-			else{
-				throw CommandException("The file '" + executable.string() + "' is not a regular file.");
+			return false;
+		}
+
+		Input InputView::toInput() const{
+			Input cmd;
+			cmd.command = command;
+			cmd.raw_args = raw_args;
+			cmd.args.reserve(args.size());
+			for(std::string_view arg : args){
+				cmd.args.emplace_back(arg);
+			}
+			for(const Kwarg& kwarg : kwargs){
+				cmd.kwargs.insert_or_assign(std::string(kwarg.first), std::string(kwarg.second));
 			}
+			return cmd;
+		}
+
+		InputView InputView::parse(std::string_view s){
+			return InputView(s);
 		}
-		else{
-			throw CommandException("The file '" + executable.string() + "' does not exist.");
+}
+
+#ifndef COMMAND_DISABLE_STATS
+namespace Command{ //Command::CommandStats class implementation
+
+	namespace{
+		//the shard of a thread: the threads are numbered in the order they record their first latency
+		size_t thread_shard(){
+			static std::atomic<size_t> threads{0};
+			thread_local const size_t shard = threads++ % CommandStats::max_shards;
+			return shard;
 		}
 	}
 
-	void CommandManager::operator()(Input& i){
-		execute(i);
+	size_t CommandStats::bucket(uint64_t ns){
+		if(ns < 2 * sub_buckets){ //the first values have their own bucket
+			return ns;
+		}
+#if defined(__GNUC__)
+		size_t exponent = 63 - __builtin_clzll(ns);
+#else
+		size_t exponent = 0;
+		for(uint64_t v = ns; v > 1; v >>= 1){
+			exponent++;
+		}
+#endif
+		size_t mantissa = (ns >> (exponent - 3)) & (sub_buckets - 1); //the 3 bits after the leading one
+		return (exponent - 2) * sub_buckets + mantissa;
 	}
-	void CommandManager::operator()(const std::string& s){
-		execute(s);
+
+	uint64_t CommandStats::highest(size_t bucket){
+		if(bucket < 2 * sub_buckets){
+			return bucket;
+		}
+		size_t exponent = bucket / sub_buckets + 2;
+		uint64_t mantissa = bucket % sub_buckets;
+		uint64_t width = uint64_t(1) << (exponent - 3);
+		return ((sub_buckets + mantissa) << (exponent - 3)) + (width - 1);
 	}
-	void CommandManager::operator()(const char* s){
-		execute(s);
+
+	void CommandStats::Histogram::record(uint64_t ns){
+		counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+		uint64_t current = max.load(std::memory_order_relaxed);
+		while(ns > current && !max.compare_exchange_weak(current, ns, std::memory_order_relaxed)){
+		}
 	}
 
-	void CommandManager::printHelp() const{
-		unsigned int max_usage_length = 0;
-		for(auto it = commands.begin(); it != commands.end(); it++){
-			if(it->second->usage.size() > max_usage_length){
-				max_usage_length = it->second->usage.size();
+	CommandStats::Shard& CommandStats::shard() const{
+		std::atomic<Shard*>& slot = shards[thread_shard()];
+		Shard* s = slot.load(std::memory_order_acquire);
+		if(s == nullptr){
+			Shard* created = new Shard(); //value-initialized: all the counters are zero
+			if(slot.compare_exchange_strong(s, created, std::memory_order_acq_rel)){
+				s = created;
+			}else{ //another thread of the same shard was faster
+				delete created;
 			}
 		}
-		for(auto it = commands.begin(); it != commands.end(); it++){
-			out << extend(it->second->usage, max_usage_length+4) << it->second->description << std::endl;
+		return *s;
+	}
+
+	CommandStats::~CommandStats(){
+		for(auto& slot : shards){
+			delete slot.load();
 		}
 	}
 
-	void CommandManager::printHelp(const std::string& name) const{
-		if(commands.find(name) != commands.end()){
-			out << "Usage :" << std::endl;
-			out << '\t' << commands.at(name)->usage << std::endl;
-			out << "Description :" << std::endl;
-			if(commands.at(name)->getLongDescription().size() > 0){
-				for(std::string line : commands.at(name)->getLongDescription()){
-					out << '\t' << line << std::endl;
-				}
-			}
-			else{
-				out << '\t' << commands.at(name)->description << std::endl;
-			}
-		}else{
-			out << "Command '" << name << "' not found." << std::endl;
+	void CommandStats::record_bind(uint64_t ns) const{
+		shard().bind.record(ns);
+	}
+
+	void CommandStats::record_bind_error() const{
+		Shard& s = shard();
+		s.calls.fetch_add(1, std::memory_order_relaxed);
+		s.errors.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void CommandStats::record_execute(uint64_t ns, bool failed) const{
+		Shard& s = shard();
+		s.calls.fetch_add(1, std::memory_order_relaxed);
+		if(failed){
+			s.errors.fetch_add(1, std::memory_order_relaxed);
 		}
+		s.execute.record(ns);
 	}
 
-	int CommandManager::mainloop(){
-		std::string line;
-		mainloop_running = true;
-		while(mainloop_running){
-			set_exit_code(EXIT_SUCCESS); //we reset the exit code
-			out << parse_question();
-			std::getline(in, line);
-			if(in.eof()){ //if the input is closed, we stop the mainloop
-				mainloop_running = false;
-				return EXIT_SUCCESS;
-			}
-			if(line.size() == 0){ //if the line is empty, we continue
+	CommandStats::Summary CommandStats::summary() const{
+		Summary summary;
+		std::array<uint64_t, buckets> bind{}, execute{};
+		for(const auto& slot : shards){
+			const Shard* s = slot.load(std::memory_order_acquire);
+			if(s == nullptr){
 				continue;
 			}
-			try{
-				execute(line);
-			}catch(CommandException& e){
-				err << e.what() << std::endl;
+			summary.calls += s->calls.load(std::memory_order_relaxed);
+			summary.errors += s->errors.load(std::memory_order_relaxed);
+			summary.bind.max = std::max(summary.bind.max, s->bind.max.load(std::memory_order_relaxed));
+			summary.execute.max = std::max(summary.execute.max, s->execute.max.load(std::memory_order_relaxed));
+			for(size_t i = 0; i < buckets; ++i){
+				bind[i] += s->bind.counts[i].load(std::memory_order_relaxed);
+				execute[i] += s->execute.counts[i].load(std::memory_order_relaxed);
 			}
 		}
-		return get_exit_code();
+		auto percentiles = [](const std::array<uint64_t, buckets>& counts, Percentiles& p){
+			for(uint64_t c : counts){
+				p.count += c;
+			}
+			std::pair<double, uint64_t*> targets[] = {{0.50, &p.p50}, {0.90, &p.p90}, {0.99, &p.p99}};
+			for(auto& target : targets){
+				uint64_t rank = (uint64_t)(target.first * p.count + 0.999999), seen = 0; //the smallest value with rank values under or equal to it
+				for(size_t i = 0; i < buckets && p.count > 0; ++i){
+					seen += counts[i];
+					if(seen >= std::max<uint64_t>(rank, 1)){
+						*target.second = std::min(highest(i), p.max);
+						break;
+					}
+				}
+			}
+		};
+		percentiles(bind, summary.bind);
+		percentiles(execute, summary.execute);
+		return summary;
 	}
+}
+#endif
 
-	PreDefinedCmd::HelpCommand::HelpCommand(std::ostream& _out)
-		: Command("help", "Prints this help message.","", "help [command]"), out(_out){
-			set_default_value("command", "");
+namespace Command{ //Command::CommandResult class implementation
+
+	std::string CommandResult::message() const{
+		switch(code){
+			case Error::None:
+				return "";
+			case Error::NotFound:
+				return "Command '" + subject + "' not found.";
+			case Error::MissingArgument:
+				return "Command '" + subject + "' required argument '" + argument + "' is missing.";
+			case Error::NoDefaultValue:
+				return "Command '" + subject + "' required argument '" + argument + "' does not have a default value.";
+			case Error::TooManyArguments:
+				return "Command '" + subject + "' has too many arguments. The command can handle " + std::to_string(expected) + " arguments, but " + std::to_string(given) + " were given.";
+			case Error::FileNotFound:
+				return "The file '" + subject + "' does not exist.";
+			case Error::NotAFile:
+				return "The file '" + subject + "' is not a regular file.";
+			case Error::SpawnFailed:
+				return "The file '" + subject + "' could not be executed: " + std::strerror(value);
+			case Error::WaitFailed:
+				return "The file '" + subject + "' could not be waited: " + std::strerror(value);
+			case Error::ExitStatus:
+				return "The file '" + subject + "' returned an error code (" + std::to_string(value) + ").";
+			case Error::Failed:
+				return text;
+		}
+		return "";
 	}
-	PreDefinedCmd::HelpCommand::~HelpCommand(){
+
+	void CommandResult::raise() const{
+		if(code != Error::None){
+			throw CommandException(message());
+		}
 	}
-	void PreDefinedCmd::HelpCommand::execute(const Kwargs& kwargs){
-		if(kwargs.at("command") == ""){
-			master->printHelp();
-		}else{
-			master->printHelp(kwargs.at("command"));
+
+}
+
+
+namespace Command{ //Command::Command class implementation
+
+
+	Command::Command(const std::string& _name, const std::string& _description, const std::vector<std::string>& long_desc, const std::string& _usage)
+		: name(_name), description(_description), long_description(long_desc), usage(_usage){
+		parse_usage();
+	}
+
+	Command::Command(const std::string& _name)
+		: name(_name), description(""), usage(_name){
+	}
+
+	Command::Command(const char* _name, const char* _description, const char** long_desc, const size_t& long_desc_size, const char* _usage)
+		: name(_name), description(_description), usage(_usage){
+		for(size_t i = 0; i < long_desc_size; i++){
+			long_description.push_back(long_desc[i]);
 		}
+		parse_usage();
 	}
 
-	void PreDefinedCmd::ExitCommand::execute(const Kwargs&){
-		master->stopMainloop();
+	Command::Command(const std::string& _name, const std::string& _description, const std::string& long_desc, const std::string& _usage)
+		: name(_name), description(_description), long_description(split(long_desc, '\n')), usage(_usage){
+		parse_usage();
+	}
+	Command::Command(const char* _name, const char* _description, const char* long_desc, const char* _usage)
+		: name(_name), description(_description), long_description(split(long_desc, '\n')), usage(_usage){
+		parse_usage();
+	}
+	
+	Command::Command(const char* _name)
+		: name(_name), description(""), usage(_name){
+	}
+
+	Command::Command(const Command& c)
+		: name(c.name), description(c.description), long_description(c.long_description), usage(c.usage),
+		  required_args(c.required_args), optional_args(c.optional_args), args_ordered(c.args_ordered),
+		  default_values(c.default_values), binding(c.binding){
+			master = nullptr;
+	}
+
+	Command::~Command(){
+	}
+
+	void Command::setDescription(const std::string& description){
+		this->description = description;
+		changed();
+	}
+	void Command::setLongDescription(const std::vector<std::string>& long_description){
+		this->long_description = long_description;
+		changed();
+	}
+	void Command::setLongDescription(const std::string& long_description){
+		this->long_description = split(long_description, '\n');
+		changed();
+	}
+	void Command::setUsage(const std::string& usage){
+		this->usage = usage;
+		parse_usage();
+		changed();
+	}
+
+	void Command::changed(){
+		std::atomic_store(&help_block, std::shared_ptr<const std::string>());
+		if(master != nullptr){
+			master->invalidate_help();
+		}
+	}
+
+	std::shared_ptr<const std::string> Command::help() const{
+		std::shared_ptr<const std::string> block = std::atomic_load(&help_block);
+		if(block != nullptr){
+			return block;
+		}
+		std::string text = "Usage :\n\t" + usage + "\nDescription :\n";
+		if(long_description.size() > 0){
+			for(const std::string& line : long_description){
+				text += '\t';
+				text += line;
+				text += '\n';
+			}
+		}else{
+			text += '\t';
+			text += description;
+			text += '\n';
+		}
+		block = std::make_shared<const std::string>(std::move(text));
+		std::atomic_store(&help_block, block);
+		return block;
+	}
+
+	void Command::setName(const std::string& name){
+		if(master == nullptr){
+			this->name = name;
+			return;
+		}
+		master->rename_command(this, name); //one modification, the command is never missing for the other threads
+	}
+
+	//count the number of required arguments (in <>) and optional arguments (in []), then compile the binding plan
+	void Command::parse_usage(){
+		required_args.clear();
+		optional_args.clear();
+		args_ordered.clear();
+		binding = Binding();
+
+		std::vector<std::string> tokens = split(usage, ' ');
+		tokens.erase(tokens.begin()); //the first token is the command name
+		for(auto t : tokens){
+			if(args_ordered.size() == max_args){
+				std::cout << "Invalid usage string (more than " << max_args << " arguments): " << usage << std::endl;
+				break;
+			}
+			const uint64_t bit = uint64_t(1) << args_ordered.size();
+			if(t == "[args...]"){
+				//the user can pass any number of arguments, they will all be given in "args...", separated by spaces
+				//this is a special case, so we handle it here
+				optional_args.push_back("args...");
+				default_values.emplace("args...", "");
+				args_ordered.push_back("args...");
+				binding.optional |= bit;
+				binding.variadic = true;
+				//if they are remaining arguments, they will be ignored
+				break; //we don't need to parse the rest of the usage string
+			}
+			if(t.size() > 2 && t[0] == '[' && t[t.size()-1] == ']'){
+				optional_args.push_back(t.substr(1, t.size()-2));
+				default_values.emplace(optional_args.back(), ""); //keep a default value set before
+				args_ordered.push_back(optional_args.back());
+				binding.optional |= bit;
+			}else if(t.size() > 2 && t[0] == '<' && t[t.size()-1] == '>'){
+				required_args.push_back(t.substr(1, t.size()-2));
+				args_ordered.push_back(required_args.back());
+				binding.required |= bit;
+			}else{
+				std::cout << "Invalid usage string: " << usage << std::endl;
+			}
+		}
+
+		binding.lookup.reserve(args_ordered.size());
+		binding.defaults.resize(args_ordered.size());
+		for(size_t slot = 0; slot < args_ordered.size(); ++slot){
+			binding.lookup.emplace_back(args_ordered[slot], slot);
+			auto it = default_values.find(args_ordered[slot]);
+			if(it != default_values.end()){
+				binding.defaults[slot] = it->second;
+				binding.has_default |= uint64_t(1) << slot;
+			}
+		}
+		std::sort(binding.lookup.begin(), binding.lookup.end());
+	}
+
+	size_t Command::Binding::slot(std::string_view arg) const{
+		auto it = std::lower_bound(lookup.begin(), lookup.end(), arg, [](const std::pair<std::string, size_t>& entry, std::string_view key){
+			return std::string_view(entry.first) < key;
+		});
+		if(it != lookup.end() && it->first == arg){
+			return it->second;
+		}
+		return npos;
+	}
+
+	void Command::bind(const InputView& input, Kwargs& kwargs) const{
+#ifndef COMMAND_DISABLE_STATS
+		const auto start = std::chrono::steady_clock::now();
+		try{
+			bind_arguments(input, kwargs);
+		}catch(CommandException&){
+			stats.record_bind_error();
+			throw;
+		}
+		stats.record_bind(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+#else
+		bind_arguments(input, kwargs);
+#endif
+	}
+
+	void Command::run(const Kwargs& kwargs){
+#ifndef COMMAND_DISABLE_STATS
+		const auto start = std::chrono::steady_clock::now();
+		auto elapsed = [&start]{ return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(); };
+		try{
+			execute(kwargs);
+		}catch(CommandException&){ //only the CommandException are counted as errors
+			stats.record_execute(elapsed(), true);
+			throw;
+		}catch(...){
+			stats.record_execute(elapsed(), false);
+			throw;
+		}
+		stats.record_execute(elapsed(), false);
+#else
+		execute(kwargs);
+#endif
+	}
+
+	void Command::invoke(const InputView& input){
+		try_invoke(input).raise();
+	}
+
+	CommandResult Command::try_invoke(const InputView& input){
+		Values values;
+		std::string rest;
+#ifndef COMMAND_DISABLE_STATS
+		using clock = std::chrono::steady_clock;
+		const clock::time_point start = clock::now();
+		CommandResult result = bind_values(input, values, rest);
+		if(!result){
+			stats.record_bind_error();
+			return result;
+		}
+		const clock::time_point bound = clock::now(); //the end of the binding is the start of the execution
+		stats.record_bind(std::chrono::duration_cast<std::chrono::nanoseconds>(bound - start).count());
+		auto elapsed = [&bound]{ return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - bound).count(); };
+		try{
+			execute_bound(values);
+		}catch(CommandException& e){
+			stats.record_execute(elapsed(), true);
+			result.code = CommandResult::Error::Failed;
+			result.text = e.what();
+			return result;
+		}catch(...){
+			stats.record_execute(elapsed(), false);
+			throw;
+		}
+		stats.record_execute(elapsed(), false);
+		return result;
+#else
+		CommandResult result = bind_values(input, values, rest);
+		if(!result){
+			return result;
+		}
+		try{
+			execute_bound(values);
+		}catch(CommandException& e){
+			result.code = CommandResult::Error::Failed;
+			result.text = e.what();
+		}
+		return result;
+#endif
+	}
+
+	CommandResult Command::try_run_bound(const Values& values){
+		CommandResult result;
+#ifndef COMMAND_DISABLE_STATS
+		using clock = std::chrono::steady_clock;
+		const clock::time_point start = clock::now();
+		auto elapsed = [&start]{ return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count(); };
+		try{
+			execute_bound(values);
+		}catch(CommandException& e){
+			stats.record_execute(elapsed(), true);
+			result.code = CommandResult::Error::Failed;
+			result.text = e.what();
+			return result;
+		}catch(...){
+			stats.record_execute(elapsed(), false);
+			throw;
+		}
+		stats.record_execute(elapsed(), false);
+#else
+		try{
+			execute_bound(values);
+		}catch(CommandException& e){
+			result.code = CommandResult::Error::Failed;
+			result.text = e.what();
+		}
+#endif
+		return result;
+	}
+
+	void Command::execute_bound(const Values& values){
+		Kwargs kwargs;
+		for(const auto& entry : binding.lookup){ //the lookup is sorted by name, so each insertion is at the end of the map
+			kwargs.emplace_hint(kwargs.end(), entry.first, values[entry.second]);
+		}
+		execute(kwargs);
+	}
+
+	void Command::bind_arguments(const InputView& input, Kwargs& kwargs) const{
+		Values values;
+		std::string rest;
+		bind_values(input, values, rest).raise();
+		for(const auto& entry : binding.lookup){ //the lookup is sorted by name, so each insertion is at the end of the map
+			kwargs.emplace_hint(kwargs.end(), entry.first, values[entry.second]);
+		}
+	}
+
+	CommandResult Command::bind_values(const InputView& input, Values& values, std::string& rest) const{
+		const size_t count = args_ordered.size();
+		uint64_t given = 0;
+
+		for(const auto& kwarg : input.getKwargs()){ //the keyword arguments take their slot first
+			size_t slot = binding.slot(kwarg.first);
+			if(slot != Binding::npos){
+				values[slot] = kwarg.second; //if a key is given several times, the last one wins
+				given |= uint64_t(1) << slot;
+			}else{
+				error() << "Command '" << name << "' does not have an argument '" << kwarg.first << "'. Ignoring it.\n";
+			}
+		}
+
+		//then the arguments fill the remaining slots, in the order of the usage
+		const std::vector<std::string_view>& args = input.getArgs();
+		size_t next = 0;
+		for(size_t slot = 0; slot < count; ++slot){
+			const uint64_t bit = uint64_t(1) << slot;
+			if(given & bit){
+				continue;
+			}
+			if(binding.variadic && slot == count - 1 && next < args.size()){
+				for(; next < args.size(); ++next){
+					if(!rest.empty()) rest += ' ';
+					rest += args[next];
+				}
+				values[slot] = rest;
+			}else if(next < args.size()){
+				values[slot] = args[next++];
+			}else if(binding.required & bit){
+				return CommandResult(CommandResult::Error::MissingArgument, name, args_ordered[slot]);
+			}else if(binding.has_default & bit){
+				values[slot] = binding.defaults[slot];
+			}else{
+				return CommandResult(CommandResult::Error::NoDefaultValue, name, args_ordered[slot]);
+			}
+			given |= bit;
+		}
+
+		//if there is more arguments than the command can handle, we print an error
+		if(next < args.size()){
+			CommandResult result(CommandResult::Error::TooManyArguments, name);
+			result.expected = count;
+			result.given = input.getArgCount() + input.getKwargCount();
+			return result;
+		}
+		return CommandResult();
+	}
+
+	void Command::set_default_value(const std::string& arg, const std::string& value){
+		default_values[arg] = value;
+		size_t slot = binding.slot(arg);
+		if(slot != Binding::npos){
+			binding.defaults[slot] = value;
+			binding.has_default |= uint64_t(1) << slot;
+		}
+	}
+	void Command::set_default_value(const char* arg, const char* value){
+		set_default_value(std::string(arg), std::string(value));
+	}
+
+	std::istream& Command::input() const{
+		if(master != nullptr){
+			return master->input();
+		}
+		return CommandManager::context && CommandManager::context->in ? *CommandManager::context->in : std::cin;
+	}
+	std::ostream& Command::output() const{
+		if(master != nullptr){
+			return master->output();
+		}
+		return CommandManager::context ? *CommandManager::context->out : std::cout;
+	}
+	std::ostream& Command::error() const{
+		if(master != nullptr){
+			return master->error();
+		}
+		return CommandManager::context ? *CommandManager::context->err : std::cerr;
+	}
+
+	char Command::is_argument(const std::string& arg) const{
+		size_t slot = binding.slot(arg);
+		if(slot == Binding::npos){
+			return 0;
+		}
+		return (binding.required >> slot) & 1 ? 1 : 2;
+	}
+
+}
+
+namespace Command{ //Command::LazyCommand class implementation
+
+	LazyCommand::LazyCommand(const std::string& _name, const std::string& _description, Factory _factory)
+		: Command(_name), factory(std::move(_factory)){
+		description = _description;
+	}
+
+	LazyCommand::~LazyCommand(){
+		delete built.load();
+	}
+
+	Command* LazyCommand::resolve(){
+		Command* c = built.load(std::memory_order_acquire);
+		if(c != nullptr){
+			return c;
+		}
+		std::lock_guard<std::mutex> lock(build_mutex);
+		c = built.load(std::memory_order_relaxed);
+		if(c == nullptr){ //the first use, or the factory threw the previous time
+			c = factory();
+			if(c == nullptr){
+				throw CommandException("The factory of the command '" + name + "' built nothing.");
+			}
+			c->name = name; //the registered name wins, the map holds it
+			c->master = master;
+			built.store(c, std::memory_order_release);
+			changed(); //the help table shows the built command now
+		}
+		return c;
+	}
+
+	Command* LazyCommand::loaded(){
+		Command* c = built.load(std::memory_order_acquire);
+		return c != nullptr ? c : this;
+	}
+
+	void LazyCommand::execute(const Kwargs& kwargs){
+		resolve()->execute(kwargs);
+	}
+
+}
+
+namespace Command{ //Command::CommandMap class implementation
+
+	size_t CommandMap::lookup(std::string_view name, size_t hash) const{
+		if(slots.empty()){
+			return npos;
+		}
+		const size_t mask = slots.size() - 1;
+		for(size_t i = hash & mask;; i = (i + 1) & mask){ //linear probing, there is always an empty slot
+			const Slot& slot = slots[i];
+			if(slot.state == Slot::Empty){
+				return npos;
+			}
+			if(slot.state == Slot::Used && slot.hash == hash && slot.name == name){
+				return i;
+			}
+		}
+	}
+
+	CommandMap::CommandMap(const CommandMap& other)
+		: slots(other.slots), used(other.used), erased(other.erased), sorted_valid(other.used == 0){
+	}
+
+	CommandMap& CommandMap::operator=(const CommandMap& other){
+		slots = other.slots;
+		used = other.used;
+		erased = other.erased;
+		sorted.clear(); //its views are on the names of the other map
+		sorted_valid = used == 0;
+		return *this;
+	}
+
+	void CommandMap::rehash(size_t capacity){
+		std::vector<Slot> old(capacity);
+		old.swap(slots);
+		erased = 0;
+		const size_t mask = slots.size() - 1;
+		for(Slot& slot : old){
+			if(slot.state != Slot::Used){
+				continue;
+			}
+			size_t i = slot.hash & mask;
+			while(slots[i].state != Slot::Empty){
+				i = (i + 1) & mask;
+			}
+			slots[i] = std::move(slot);
+		}
+	}
+
+	Command* CommandMap::find(std::string_view name) const{
+		size_t i = lookup(name, std::hash<std::string_view>()(name));
+		return i == npos ? nullptr : slots[i].command;
+	}
+
+	Command* CommandMap::at(std::string_view name) const{
+		Command* command = find(name);
+		if(command == nullptr){
+			throw std::out_of_range("CommandMap: no command '" + std::string(name) + "'");
+		}
+		return command;
+	}
+
+	Command* CommandMap::insert(std::string_view name, Command* command){
+		const size_t hash = std::hash<std::string_view>()(name);
+		size_t i = lookup(name, hash);
+		if(i != npos){
+			std::swap(slots[i].command, command);
+			sorted_valid = false;
+			return command;
+		}
+		if((used + erased + 1) * 2 > slots.size()){ //keep the load factor under 1/2
+			size_t capacity = slots.empty() ? 16 : slots.size();
+			while((used + 1) * 2 > capacity){
+				capacity *= 2;
+			}
+			rehash(capacity);
+		}
+		const size_t mask = slots.size() - 1;
+		i = hash & mask;
+		while(slots[i].state == Slot::Used){
+			i = (i + 1) & mask;
+		}
+		if(slots[i].state == Slot::Erased){
+			erased--;
+		}
+		slots[i].name = name;
+		slots[i].command = command;
+		slots[i].hash = hash;
+		slots[i].state = Slot::Used;
+		used++;
+		sorted_valid = false;
+		return nullptr;
+	}
+
+	Command* CommandMap::erase(std::string_view name){
+		size_t i = lookup(name, std::hash<std::string_view>()(name));
+		if(i == npos){
+			return nullptr;
+		}
+		Command* command = slots[i].command;
+		slots[i].name.clear();
+		slots[i].command = nullptr;
+		slots[i].state = Slot::Erased;
+		used--;
+		erased++;
+		sorted_valid = false;
+		return command;
+	}
+
+	const std::vector<CommandMap::Entry>& CommandMap::ordered() const{
+		if(!sorted_valid){
+			sorted.clear();
+			sorted.reserve(used);
+			for(const Slot& slot : slots){
+				if(slot.state == Slot::Used){
+					sorted.emplace_back(slot.name, slot.command);
+				}
+			}
+			std::sort(sorted.begin(), sorted.end(), [](const Entry& a, const Entry& b){ return a.first < b.first; });
+			sorted_valid = true;
+		}
+		return sorted;
+	}
+}
+
+namespace Command{ //Command::NameIndex class implementation
+
+	static size_t edit_distance_dp(std::string_view a, std::string_view b){
+		if(a.size() < b.size()){
+			std::swap(a, b); //b is the shortest, it's the row
+		}
+		std::vector<size_t> row(b.size() + 1);
+		for(size_t j = 0; j <= b.size(); ++j){
+			row[j] = j;
+		}
+		for(size_t i = 1; i <= a.size(); ++i){
+			size_t diagonal = row[0];
+			row[0] = i;
+			for(size_t j = 1; j <= b.size(); ++j){
+				size_t above = row[j];
+				row[j] = std::min({above + 1, row[j-1] + 1, diagonal + (a[i-1] != b[j-1])});
+				diagonal = above;
+			}
+		}
+		return row[b.size()];
+	}
+
+	//the bit-parallel algorithm of Myers, as formulated by Hyyrö; the pattern is 1 to 64 characters long
+	static size_t edit_distance_bits(const std::array<uint64_t, 256>& peq, size_t m, std::string_view text){
+		//Pv/Mv: the positive/negative vertical deltas of the current column of the DP matrix, one bit per pattern character
+		uint64_t pv = m == 64 ? ~uint64_t(0) : (uint64_t(1) << m) - 1;
+		uint64_t mv = 0;
+		const uint64_t last = uint64_t(1) << (m - 1);
+		size_t score = m;
+		for(unsigned char c : text){
+			const uint64_t eq = peq[c];
+			const uint64_t xv = eq | mv;
+			const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+			uint64_t ph = mv | ~(xh | pv);
+			uint64_t mh = pv & xh;
+			score += (ph & last) != 0; //branchless: the sign of the delta is random on typos
+			score -= (mh & last) != 0;
+			ph = (ph << 1) | 1; //the first row of the matrix grows by one at each column
+			mh <<= 1;
+			pv = mh | ~(xv | ph);
+			mv = ph & xv;
+		}
+		return score;
+	}
+
+	size_t edit_distance(std::string_view a, std::string_view b){
+		if(a.size() < b.size()){
+			std::swap(a, b); //the pattern is the shortest
+		}
+		if(b.empty()){
+			return a.size();
+		}
+		if(b.size() > EditDistance::max_bit_parallel){
+			return edit_distance_dp(a, b);
+		}
+		std::array<uint64_t, 256> peq{};
+		for(size_t i = 0; i < b.size(); ++i){
+			peq[(unsigned char)b[i]] |= uint64_t(1) << i;
+		}
+		return edit_distance_bits(peq, b.size(), a);
+	}
+
+	EditDistance::EditDistance(std::string_view _pattern)
+		: pattern(_pattern){
+		if(pattern.size() <= max_bit_parallel){
+			for(size_t i = 0; i < pattern.size(); ++i){
+				peq[(unsigned char)pattern[i]] |= uint64_t(1) << i;
+			}
+		}
+	}
+
+	size_t EditDistance::scalar(std::string_view text) const{
+		const size_t m = pattern.size();
+		if(m == 0){
+			return text.size();
+		}
+		if(m > max_bit_parallel){
+			return edit_distance_dp(pattern, text);
+		}
+		return edit_distance_bits(peq, m, text);
+	}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COMMAND_HAS_AVX2_KERNEL 1
+	__attribute__((target("avx2")))
+	static void edit_distance_avx2(const std::array<uint64_t, 256>& peq, size_t m, const std::string_view* texts, size_t* distances){
+		//the same algorithm as EditDistance::scalar, with one string per 64 bits lane; a lane stops changing after the end of its string
+		const __m256i ones = _mm256_set1_epi64x(-1);
+		const __m256i one = _mm256_set1_epi64x(1);
+		__m256i pv = _mm256_set1_epi64x(m == 64 ? -1 : (int64_t)((uint64_t(1) << m) - 1));
+		__m256i mv = _mm256_setzero_si256();
+		__m256i score = _mm256_set1_epi64x((int64_t)m);
+		size_t longest = 0;
+		for(size_t lane = 0; lane < 4; ++lane){
+			longest = std::max(longest, texts[lane].size());
+		}
+		const __m256i lengths = _mm256_set_epi64x((int64_t)texts[3].size(), (int64_t)texts[2].size(), (int64_t)texts[1].size(), (int64_t)texts[0].size());
+		auto at = [&](size_t lane, size_t j) -> int64_t {
+			return j < texts[lane].size() ? (int64_t)peq[(unsigned char)texts[lane][j]] : 0;
+		};
+		for(size_t j = 0; j < longest; ++j){
+			const __m256i eq = _mm256_set_epi64x(at(3, j), at(2, j), at(1, j), at(0, j));
+			const __m256i mask = _mm256_cmpgt_epi64(lengths, _mm256_set1_epi64x((int64_t)j)); //the lanes still in their string
+			const __m256i xv = _mm256_or_si256(eq, mv);
+			const __m256i xh = _mm256_or_si256(_mm256_xor_si256(_mm256_add_epi64(_mm256_and_si256(eq, pv), pv), pv), eq);
+			__m256i ph = _mm256_or_si256(mv, _mm256_xor_si256(_mm256_or_si256(xh, pv), ones));
+			__m256i mh = _mm256_and_si256(pv, xh);
+			const __m256i up = _mm256_and_si256(_mm256_srli_epi64(ph, (int)(m - 1)), one);
+			const __m256i down = _mm256_and_si256(_mm256_srli_epi64(mh, (int)(m - 1)), one);
+			score = _mm256_add_epi64(score, _mm256_and_si256(_mm256_sub_epi64(up, down), mask));
+			ph = _mm256_or_si256(_mm256_slli_epi64(ph, 1), one);
+			mh = _mm256_slli_epi64(mh, 1);
+			pv = _mm256_blendv_epi8(pv, _mm256_or_si256(mh, _mm256_xor_si256(_mm256_or_si256(xv, ph), ones)), mask);
+			mv = _mm256_blendv_epi8(mv, _mm256_and_si256(ph, xv), mask);
+		}
+		alignas(32) int64_t scores[4];
+		_mm256_store_si256((__m256i*)scores, score);
+		for(size_t lane = 0; lane < 4; ++lane){
+			distances[lane] = (size_t)scores[lane];
+		}
+	}
+#endif
+
+	void EditDistance::batch4(const std::string_view* texts, size_t* distances) const{
+#ifdef COMMAND_HAS_AVX2_KERNEL
+		static const bool avx2 = __builtin_cpu_supports("avx2");
+		if(avx2){
+			edit_distance_avx2(peq, pattern.size(), texts, distances);
+			return;
+		}
+#endif
+		for(size_t lane = 0; lane < 4; ++lane){
+			distances[lane] = scalar(texts[lane]);
+		}
+	}
+
+	size_t EditDistance::operator()(std::string_view text) const{
+		return scalar(text);
+	}
+
+	void EditDistance::operator()(const std::string_view* texts, size_t count, size_t* distances) const{
+		size_t i = 0;
+		if(pattern.size() > 0 && pattern.size() <= max_bit_parallel){
+			for(; i + 4 <= count; i += 4){
+				batch4(texts + i, distances + i);
+			}
+		}
+		for(; i < count; ++i){
+			distances[i] = scalar(texts[i]);
+		}
+	}
+
+	size_t NameIndex::find(std::string_view name) const{
+		if(nodes.empty()){
+			return npos;
+		}
+		size_t current = 0;
+		while(true){
+			size_t d = edit_distance(name, nodes[current].name);
+			if(d == 0){
+				return current;
+			}
+			size_t next = npos;
+			for(const auto& child : nodes[current].children){
+				if(child.first == d){
+					next = child.second;
+					break;
+				}
+			}
+			if(next == npos){
+				return npos;
+			}
+			current = next;
+		}
+	}
+
+	void NameIndex::insert(std::string_view name){
+		if(nodes.empty()){
+			nodes.push_back(Node{std::string(name), true, {}});
+			alive = 1;
+			return;
+		}
+		size_t current = 0;
+		while(true){
+			size_t d = edit_distance(name, nodes[current].name);
+			if(d == 0){ //already there, maybe removed
+				if(!nodes[current].alive){
+					nodes[current].alive = true;
+					alive++;
+				}
+				return;
+			}
+			size_t next = npos;
+			for(const auto& child : nodes[current].children){
+				if(child.first == d){
+					next = child.second;
+					break;
+				}
+			}
+			if(next == npos){
+				nodes[current].children.emplace_back(d, nodes.size());
+				nodes.push_back(Node{std::string(name), true, {}});
+				alive++;
+				return;
+			}
+			current = next;
+		}
+	}
+
+	void NameIndex::erase(std::string_view name){
+		size_t i = find(name);
+		if(i == npos || !nodes[i].alive){
+			return;
+		}
+		nodes[i].alive = false;
+		alive--;
+		if(alive < nodes.size() - alive){ //more dead nodes than living ones
+			rebuild();
+		}
+	}
+
+	void NameIndex::rebuild(){
+		std::vector<Node> old;
+		old.swap(nodes);
+		alive = 0;
+		for(Node& node : old){
+			if(node.alive){
+				insert(node.name);
+			}
+		}
+	}
+
+	std::vector<NameIndex::Match> NameIndex::query(std::string_view name, size_t max) const{
+		std::vector<Match> matches;
+		if(nodes.empty()){
+			return matches;
+		}
+		const EditDistance distance(name); //compiled once for the whole query
+		//the tree is walked level by level, so the distances of a whole level are computed in one batch
+		std::vector<size_t> level{0}, next;
+		std::vector<std::string_view> texts;
+		std::vector<size_t> distances;
+		while(!level.empty()){
+			texts.clear();
+			for(size_t i : level){
+				texts.push_back(nodes[i].name);
+			}
+			distances.resize(level.size());
+			distance(texts.data(), texts.size(), distances.data());
+			next.clear();
+			for(size_t k = 0; k < level.size(); ++k){
+				const Node& node = nodes[level[k]];
+				const size_t d = distances[k];
+				if(d <= max && node.alive){
+					matches.emplace_back(d, node.name);
+				}
+				//triangle inequality: only the children at a distance in [d-max, d+max] of this node can match
+				for(const auto& child : node.children){
+					if(child.first + max >= d && child.first <= d + max){
+						next.push_back(child.second);
+					}
+				}
+			}
+			level.swap(next);
+		}
+		std::sort(matches.begin(), matches.end());
+		return matches;
+	}
+}
+
+namespace{ //the terminals and the sinks
+
+	/**
+	 * @brief true if the stream writes to a terminal, whose user expects to see each line when it's written
+	 */
+	bool terminal_output(const std::ostream& os){
+#ifndef _WIN32
+		if(&os == &std::cout){
+			return isatty(STDOUT_FILENO);
+		}
+		if(&os == &std::cerr || &os == &std::clog){
+			return isatty(STDERR_FILENO);
+		}
+		return false;
+#else
+		return &os == &std::cout || &os == &std::cerr || &os == &std::clog;
+#endif
+	}
+
+	/**
+	 * @brief true if the stream reads from a terminal, whose user expects a prompt before each line
+	 */
+	bool terminal_input(const std::istream& is){
+#ifndef _WIN32
+		return &is == &std::cin && isatty(STDIN_FILENO);
+#else
+		return &is == &std::cin;
+#endif
+	}
+
+	/**
+	 * @brief flush a stream, and its sink if it has one (a sink doesn't write when its stream is flushed)
+	 */
+	void flush_stream(std::ostream& os){
+		if(Command::OutputSink* sink = dynamic_cast<Command::OutputSink*>(os.rdbuf())){
+			sink->flush();
+		}else{
+			os.flush();
+		}
+	}
+}
+
+#ifndef _WIN32
+namespace{ //forwarding of the output of the external programs
+
+	//the buffers of the standard streams, as they are at startup, so we know when a stream writes directly on a file descriptor
+	std::streambuf* const stdin_buffer = std::cin.rdbuf();
+	std::streambuf* const stdout_buffer = std::cout.rdbuf();
+	std::streambuf* const stderr_buffer = std::cerr.rdbuf();
+	std::streambuf* const stdlog_buffer = std::clog.rdbuf();
+
+	/**
+	 * @brief get the file descriptor a stream writes to, if it's one of the standard streams
+	 * @return the file descriptor, or -1 if the stream doesn't write directly to a file descriptor
+	 */
+	int stream_fd(const std::ostream& os){
+		std::streambuf* buffer = os.rdbuf();
+		if(const Command::OutputSink* sink = dynamic_cast<const Command::OutputSink*>(buffer)){ //the sink must be flushed before
+			buffer = sink->getTarget();
+		}
+		if(buffer == stdout_buffer){
+			return STDOUT_FILENO;
+		}
+		if(buffer == stderr_buffer || buffer == stdlog_buffer){
+			return STDERR_FILENO;
+		}
+		return -1;
+	}
+
+	/**
+	 * @brief move what is available in a pipe to its destination
+	 * @param pipe: the read end of the pipe
+	 * @param fd: the file descriptor to write to, or -1 to write to the stream
+	 * @param os: the stream to write to if there is no file descriptor
+	 * @param buffer: a buffer for the copies
+	 * @return false when the pipe is closed
+	 */
+	bool forward(int pipe, int& fd, std::ostream& os, std::vector<char>& buffer){
+#ifdef __linux__
+		if(fd >= 0){
+			ssize_t n = splice(pipe, nullptr, fd, nullptr, 1 << 16, SPLICE_F_MOVE | SPLICE_F_MORE);
+			if(n >= 0){
+				return n > 0;
+			}
+			if(errno == EINTR || errno == EAGAIN){
+				return true;
+			}
+			fd = -1; //the destination doesn't support splice, use the copy below from now on
+		}
+#endif
+		ssize_t n = read(pipe, buffer.data(), buffer.size());
+		if(n < 0){
+			return errno == EINTR || errno == EAGAIN;
+		}
+		if(n == 0){
+			return false;
+		}
+		os.write(buffer.data(), n); //without splice, the stream writes to the file descriptor itself
+		return bool(os); //if nobody reads the stream anymore, closing the pipe tells the child with SIGPIPE
+	}
+
+	/**
+	 * @brief forward the output and error pipes of a child to the given streams, until the child closes them
+	 */
+	void forward_output(int out_pipe, std::ostream& out, int err_pipe, std::ostream& err){
+		std::vector<char> buffer(1 << 16);
+		int out_fd = stream_fd(out), err_fd = stream_fd(err);
+		pollfd fds[2] = {{out_pipe, POLLIN, 0}, {err_pipe, POLLIN, 0}};
+		int open = 2;
+		while(open > 0){
+			if(poll(fds, 2, -1) < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				break;
+			}
+			for(int k = 0; k < 2; ++k){
+				if(fds[k].fd < 0 || fds[k].revents == 0){
+					continue;
+				}
+				bool alive = k == 0 ? forward(fds[k].fd, out_fd, out, buffer) : forward(fds[k].fd, err_fd, err, buffer);
+				if(!alive){
+					close(fds[k].fd);
+					fds[k].fd = -1; //poll ignores negative file descriptors
+					open--;
+				}
+			}
+		}
+		for(const pollfd& p : fds){
+			if(p.fd >= 0){
+				close(p.fd);
+			}
+		}
+		out.flush();
+		err.flush();
+	}
+}
+#endif
+
+namespace Command{ //Command::EpochDomain class implementation
+
+	namespace{
+		/**
+		 * @brief The slot a thread tries first, different for each thread so they rarely compete for one
+		 */
+		size_t reader_hint(){
+			static std::atomic<size_t> next{0};
+			thread_local const size_t hint = next.fetch_add(1, std::memory_order_relaxed);
+			return hint;
+		}
+
+		/**
+		 * @brief A slot held by the current thread, and the number of guards nested in it
+		 */
+		struct Held{
+			const EpochDomain* domain;
+			size_t slot;
+			size_t depth;
+		};
+		/**
+		 * @brief The slots held by the current thread: its nested guards share one, a command can run commands without taking more
+		 */
+		thread_local std::vector<Held> held;
+	}
+
+	EpochDomain::Guard::Guard(const EpochDomain& _domain)
+		: domain(_domain), slot(_domain.enter()){
+	}
+	EpochDomain::Guard::~Guard(){
+		domain.exit(slot);
+	}
+
+	size_t EpochDomain::enter() const{
+		for(Held& h : held){
+			if(h.domain == this){ //the outermost guard already protects what this one sees
+				++h.depth;
+				return h.slot;
+			}
+		}
+		EpochDomain& self = const_cast<EpochDomain&>(*this); //the slots are the only state of a reader
+		for(size_t i = reader_hint() % max_readers, tries = 0;; i = (i + 1) % max_readers){
+			std::uint64_t free = 0;
+			//the epoch is read before the claim, so it can only be older than the real one, which is safe
+			if(self.readers[i].epoch.compare_exchange_strong(free, current.load(std::memory_order_seq_cst), std::memory_order_seq_cst)){
+				held.push_back(Held{this, i, 1});
+				return i;
+			}
+			if(++tries % max_readers == 0){ //all the slots are taken
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void EpochDomain::exit(size_t slot) const{
+		for(size_t k = held.size(); k-- > 0;){
+			if(held[k].domain == this){
+				if(--held[k].depth > 0){
+					return;
+				}
+				held.erase(held.begin() + k);
+				break;
+			}
+		}
+		const_cast<EpochDomain&>(*this).readers[slot].epoch.store(0, std::memory_order_release);
+	}
+
+	std::uint64_t EpochDomain::advance(){
+		return current.fetch_add(1, std::memory_order_seq_cst) + 1;
+	}
+
+	bool EpochDomain::quiescent(std::uint64_t epoch) const{
+		for(const Slot& slot : readers){
+			std::uint64_t e = slot.epoch.load(std::memory_order_acquire);
+			if(e != 0 && e < epoch){
+				return false;
+			}
+		}
+		return true;
+	}
+
+}
+
+namespace Command{ //Command::OutputSink class implementation
+
+	OutputSink::OutputSink(std::streambuf* _target, Mode _mode, size_t capacity)
+		: target(_target), buffer(capacity), mode(_mode){
+		if(mode == Mode::Full){
+			setp(buffer.data(), buffer.data() + buffer.size());
+		}
+	}
+
+	OutputSink::~OutputSink(){
+		drain();
+	}
+
+	void OutputSink::drain(){
+		size_t n = mode == Mode::Full ? pptr() - pbase() : used;
+		if(n > 0 && target != nullptr){
+			target->sputn(buffer.data(), n);
+		}
+		used = 0;
+		if(mode == Mode::Full){
+			setp(buffer.data(), buffer.data() + buffer.size());
+		}
+	}
+
+	void OutputSink::flush(){
+		drain();
+		if(target != nullptr){
+			target->pubsync();
+		}
+	}
+
+	void OutputSink::setMode(Mode _mode){
+		flush();
+		mode = _mode;
+		if(mode == Mode::Full){
+			setp(buffer.data(), buffer.data() + buffer.size());
+		}else{
+			setp(nullptr, nullptr); //each write goes through xsputn() or overflow(), which look for the ends of line
+		}
+	}
+
+	OutputSink::int_type OutputSink::overflow(int_type c){
+		if(traits_type::eq_int_type(c, traits_type::eof())){
+			return traits_type::not_eof(c);
+		}
+		char ch = traits_type::to_char_type(c);
+		xsputn(&ch, 1);
+		return c;
+	}
+
+	std::streamsize OutputSink::xsputn(const char* s, std::streamsize n){
+		if(tied != nullptr){
+			tied->flush();
+		}
+		if(mode == Mode::Full){
+			if(n > epptr() - pptr()){
+				drain();
+				if(n >= (std::streamsize)buffer.size()){ //too big for the buffer, written as it is
+					return target != nullptr ? target->sputn(s, n) : n;
+				}
+			}
+			std::memcpy(pptr(), s, n);
+			pbump((int)n);
+			return n;
+		}
+
+		for(std::streamsize done = 0; done < n;){
+			size_t chunk = std::min<size_t>(n - done, buffer.size() - used);
+			std::memcpy(buffer.data() + used, s + done, chunk);
+			used += chunk;
+			done += chunk;
+			if(used == buffer.size()){
+				drain();
+			}
+		}
+		if(std::memchr(s, '\n', n) != nullptr){
+			flush();
+		}
+		return n;
+	}
+
+	int OutputSink::sync(){
+		if(mode == Mode::Line){
+			flush();
+		}
+		return 0; //in Full mode, a flush of the stream (std::endl) doesn't write anything
+	}
+
+}
+
+namespace Command{ //Command::ThreadPool and Command::Job implementation
+
+	/**
+	 * @brief A work-stealing pool of threads: each worker has its own queue, and takes from the others' when its own is empty
+	 * @note the tasks submitted by a worker go in its own queue; the destructor runs all the queued tasks before joining the threads
+	 */
+	class ThreadPool{
+		private:
+			struct Queue{
+				std::mutex mutex;
+				std::deque<std::function<void()>> tasks;
+			};
+			std::vector<std::unique_ptr<Queue>> queues;
+			std::vector<std::thread> threads;
+			/**
+			 * @brief The number of queued tasks, over all the queues
+			 */
+			std::atomic<size_t> pending{0};
+			/**
+			 * @brief The queue for the next task submitted from outside the pool
+			 */
+			std::atomic<size_t> next{0};
+			/**
+			 * @brief protect the sleeping of the workers
+			 */
+			std::mutex mutex;
+			std::condition_variable wake;
+			bool stopping = false;
+
+			static thread_local ThreadPool* current_pool;
+			static thread_local size_t current_worker;
+
+			bool take(size_t self, std::function<void()>& task){
+				{ //the last pushed task of our queue first
+					std::lock_guard<std::mutex> lock(queues[self]->mutex);
+					if(!queues[self]->tasks.empty()){
+						task = std::move(queues[self]->tasks.back());
+						queues[self]->tasks.pop_back();
+						return true;
+					}
+				}
+				for(size_t k = 1; k < queues.size(); ++k){ //then the oldest task of another queue
+					Queue& victim = *queues[(self + k) % queues.size()];
+					std::lock_guard<std::mutex> lock(victim.mutex);
+					if(!victim.tasks.empty()){
+						task = std::move(victim.tasks.front());
+						victim.tasks.pop_front();
+						return true;
+					}
+				}
+				return false;
+			}
+
+			void run(size_t self){
+				current_pool = this;
+				current_worker = self;
+				std::function<void()> task;
+				while(true){
+					if(take(self, task)){
+						pending--;
+						task();
+						task = nullptr;
+						continue;
+					}
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [this]{ return stopping || pending > 0; });
+					if(stopping && pending == 0){
+						return;
+					}
+				}
+			}
+
+		public:
+			explicit ThreadPool(size_t count){
+				if(count == 0){
+					count = std::max(1u, std::thread::hardware_concurrency());
+				}
+				for(size_t i = 0; i < count; ++i){
+					queues.push_back(std::make_unique<Queue>());
+				}
+				for(size_t i = 0; i < count; ++i){
+					threads.emplace_back(&ThreadPool::run, this, i);
+				}
+			}
+
+			~ThreadPool(){
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+				}
+				wake.notify_all();
+				for(std::thread& t : threads){
+					t.join();
+				}
+			}
+
+			void submit(std::function<void()> task){
+				size_t target = current_pool == this ? current_worker : next++ % queues.size();
+				{
+					std::lock_guard<std::mutex> lock(queues[target]->mutex);
+					queues[target]->tasks.push_back(std::move(task));
+				}
+				pending++;
+				{ //a worker checking if it should sleep holds this mutex, so it can't miss the notification
+					std::lock_guard<std::mutex> lock(mutex);
+				}
+				wake.notify_one();
+			}
+	};
+	thread_local ThreadPool* ThreadPool::current_pool = nullptr;
+	thread_local size_t ThreadPool::current_worker = 0;
+
+	class Job;
+
+	/**
+	 * @brief A stream buffer keeping what a job writes until the manager prints it
+	 */
+	class JobBuffer : public std::streambuf{
+		private:
+			Job& job;
+			std::string& data;
+		protected:
+			int_type overflow(int_type c) override;
+			std::streamsize xsputn(const char* s, std::streamsize n) override;
+		public:
+			JobBuffer(Job& _job, std::string& _data) : job(_job), data(_data) {}
+	};
+
+	/**
+	 * @brief A line running in background
+	 */
+	class Job{
+		public:
+			enum State{ Running, Done, Failed };
+
+			const size_t id;
+			/**
+			 * @brief The line of the job, the InputView of the job looks at it
+			 */
+			const std::string line;
+			/**
+			 * @brief The job this one waits for, 0 if none; protected by the jobs_mutex of the manager
+			 */
+			size_t awaiting = 0;
+			/**
+			 * @brief protect everything below
+			 */
+			std::mutex mutex;
+			/**
+			 * @brief notified when there is new output or when the job ends
+			 */
+			std::condition_variable changed;
+			State state = Running;
+			/**
+			 * @brief whether a worker runs it: a job queued behind the one waiting for it may never run
+			 */
+			bool started = false;
+			int exit_code = EXIT_SUCCESS;
+			/**
+			 * @brief The output not printed yet
+			 */
+			std::string out_data, err_data;
+
+			JobBuffer out_buffer{*this, out_data}, err_buffer{*this, err_data};
+			std::ostream out{&out_buffer}, err{&err_buffer};
+			/**
+			 * @brief A job has no input, reading it fails at once
+			 */
+			std::istream in{nullptr};
+
+			Job(size_t _id, std::string_view _line) : id(_id), line(_line) {}
+
+			void finish(State s, int code){
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					state = s;
+					exit_code = code;
+				}
+				changed.notify_all();
+			}
+	};
+
+	JobBuffer::int_type JobBuffer::overflow(int_type c){
+		if(c != traits_type::eof()){
+			char ch = traits_type::to_char_type(c);
+			xsputn(&ch, 1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	std::streamsize JobBuffer::xsputn(const char* s, std::streamsize n){
+		{
+			std::lock_guard<std::mutex> lock(job.mutex);
+			data.append(s, n);
+		}
+		job.changed.notify_all();
+		return n;
+	}
+}
+
+namespace Command{ //Command::Pipe implementation, the streams between the commands of a pipeline
+
+	/**
+	 * @brief A bounded ring buffer between the threads of two commands
+	 * @note the writer blocks when it's full, the reader when it's empty; once the reader is gone, what is written is dropped
+	 */
+	class Pipe{
+		private:
+			std::mutex mutex;
+			std::condition_variable readable, writable;
+			std::vector<char> ring;
+			size_t head = 0, size = 0;
+			bool closed = false, abandoned = false;
+
+		public:
+			explicit Pipe(size_t capacity = 1 << 16) : ring(capacity) {}
+
+			/**
+			 * @return false if the reader is gone
+			 */
+			bool write(const char* s, size_t n){
+				std::unique_lock<std::mutex> lock(mutex);
+				while(n > 0){
+					writable.wait(lock, [this]{ return abandoned || size < ring.size(); });
+					if(abandoned){
+						return false;
+					}
+					size_t tail = (head + size) % ring.size();
+					size_t chunk = std::min(n, std::min(ring.size() - size, ring.size() - tail));
+					std::memcpy(ring.data() + tail, s, chunk);
+					size += chunk;
+					s += chunk;
+					n -= chunk;
+					readable.notify_one();
+				}
+				return !abandoned;
+			}
+
+			/**
+			 * @return the number of read bytes, 0 once the writer has closed the pipe and everything was read
+			 */
+			size_t read(char* s, size_t n){
+				std::unique_lock<std::mutex> lock(mutex);
+				readable.wait(lock, [this]{ return closed || size > 0; });
+				size_t chunk = std::min(n, std::min(size, ring.size() - head));
+				std::memcpy(s, ring.data() + head, chunk);
+				head = (head + chunk) % ring.size();
+				size -= chunk;
+				writable.notify_one();
+				return chunk;
+			}
+
+			void close(){
+				std::lock_guard<std::mutex> lock(mutex);
+				closed = true;
+				readable.notify_all();
+			}
+
+			void abandon(){
+				std::lock_guard<std::mutex> lock(mutex);
+				abandoned = true;
+				writable.notify_all();
+			}
+	};
+
+	/**
+	 * @brief The stream buffer writing into a pipe
+	 * @note once the reader is gone, the writes fail, so the stream goes bad
+	 */
+	class PipeWriter : public std::streambuf{
+		private:
+			Pipe& pipe;
+			char buffer[4096];
+		protected:
+			int_type overflow(int_type c) override{
+				if(sync() != 0){
+					return traits_type::eof();
+				}
+				if(c != traits_type::eof()){
+					*pptr() = traits_type::to_char_type(c);
+					pbump(1);
+				}
+				return traits_type::not_eof(c);
+			}
+			int sync() override{
+				bool open = pipe.write(pbase(), pptr() - pbase());
+				setp(buffer, buffer + sizeof(buffer));
+				return open ? 0 : -1;
+			}
+			std::streamsize xsputn(const char* s, std::streamsize n) override{
+				if(n < epptr() - pptr()){
+					std::memcpy(pptr(), s, n);
+					pbump((int)n);
+					return n;
+				}
+				if(sync() != 0 || !pipe.write(s, n)){ //big writes go straight to the ring
+					return 0;
+				}
+				return n;
+			}
+		public:
+			explicit PipeWriter(Pipe& _pipe) : pipe(_pipe){
+				setp(buffer, buffer + sizeof(buffer));
+			}
+	};
+
+	/**
+	 * @brief The stream buffer reading from a pipe
+	 */
+	class PipeReader : public std::streambuf{
+		private:
+			Pipe& pipe;
+			char buffer[4096];
+		protected:
+			int_type underflow() override{
+				size_t n = pipe.read(buffer, sizeof(buffer));
+				if(n == 0){
+					return traits_type::eof();
+				}
+				setg(buffer, buffer, buffer + n);
+				return traits_type::to_int_type(buffer[0]);
+			}
+		public:
+			explicit PipeReader(Pipe& _pipe) : pipe(_pipe){
+				setg(buffer, buffer, buffer);
+			}
+	};
+}
+
+namespace{ //the files of commands run by execute_script()
+
+	/**
+	 * @brief A whole file, read-only, mapped in memory (read into a string where there is no mmap)
+	 */
+	class MappedFile{
+		private:
+			const char* memory = nullptr;
+			size_t length = 0;
+#ifdef _WIN32
+			std::string copy;
+#endif
+
+		public:
+			/**
+			 * @throw CommandException if the file can't be opened or mapped
+			 */
+			explicit MappedFile(const std::string& path){
+#ifndef _WIN32
+				int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+				if(fd < 0){
+					throw Command::CommandException("The script '" + path + "' could not be opened: " + std::strerror(errno));
+				}
+				struct stat st;
+				if(::fstat(fd, &st) != 0){
+					const int e = errno;
+					::close(fd);
+					throw Command::CommandException("The script '" + path + "' could not be opened: " + std::strerror(e));
+				}
+				length = size_t(st.st_size);
+				if(length > 0){ //an empty file can't be mapped
+					void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+					if(mapped == MAP_FAILED){
+						const int e = errno;
+						::close(fd);
+						throw Command::CommandException("The script '" + path + "' could not be mapped: " + std::strerror(e));
+					}
+					::madvise(mapped, length, MADV_SEQUENTIAL); //it's read once, from the start
+					memory = static_cast<const char*>(mapped);
+				}
+				::close(fd);
+#else
+				std::ifstream file(path, std::ios::binary);
+				if(!file){
+					throw Command::CommandException("The script '" + path + "' could not be opened.");
+				}
+				copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+				memory = copy.data();
+				length = copy.size();
+#endif
+			}
+			~MappedFile(){
+#ifndef _WIN32
+				if(memory != nullptr){
+					::munmap(const_cast<char*>(memory), length);
+				}
+#endif
+			}
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			inline std::string_view content() const { return std::string_view(memory, length); }
+	};
+
+	/**
+	 * @brief call f(number, line) for each line of a script which is not empty nor a comment, a trailing '\r' removed
+	 */
+	template<typename F>
+	void for_each_script_line(std::string_view text, F f){
+		size_t number = 0;
+		for(size_t begin = 0; begin < text.size();){
+			const size_t end = std::min(text.find('\n', begin), text.size());
+			std::string_view line = text.substr(begin, end - begin);
+			begin = end + 1;
+			++number;
+			if(!line.empty() && line.back() == '\r'){
+				line.remove_suffix(1);
+			}
+			const size_t first = line.find_first_not_of(" \t");
+			if(first == std::string_view::npos || line[first] == '#'){ //an empty line or a comment
+				continue;
+			}
+			f(number, line);
+		}
+	}
+
+	/**
+	 * @brief FNV-1a, a hash which doesn't change between builds, for the keys of the compiled scripts
+	 */
+	inline uint64_t fnv1a(std::string_view s, uint64_t h = 14695981039346656037ull){
+		for(char c : s){
+			h = (h ^ uint8_t(c)) * 1099511628211ull;
+		}
+		return h;
+	}
+
+	/**
+	 * @brief the checksum of a compiled script: FNV-1a over words of 8 bytes, the scripts can be large
+	 */
+	inline uint64_t script_checksum(std::string_view s){
+		uint64_t h = 14695981039346656037ull;
+		size_t i = 0;
+		for(uint64_t word; i + sizeof(word) <= s.size(); i += sizeof(word)){
+			std::memcpy(&word, s.data() + i, sizeof(word));
+			h = (h ^ word) * 1099511628211ull;
+			h ^= h >> 29;
+		}
+		return fnv1a(s.substr(i), h);
+	}
+
+	/**
+	 * @brief The head of a compiled script file, followed by the path of the script, then by the compiled script
+	 * @note the file is only read on the machine which wrote it, it's in its byte order
+	 */
+	struct ScriptHeader{
+		char magic[8];
+		uint32_t version;
+		uint32_t path_size;
+		/**
+		 * @brief the key: the size and the modification time of the script, and the fingerprint of the registered commands
+		 */
+		uint64_t size;
+		int64_t mtime;
+		uint64_t commands;
+		uint64_t code_size;
+		/**
+		 * @brief the hash of the compiled script, a damaged one is compiled again
+		 */
+		uint64_t checksum;
+	};
+	constexpr char script_magic[8] = {'C', 'M', 'D', 'S', 'C', 'R', 'P', 'T'};
+	constexpr uint32_t script_version = 3;
+
+	/**
+	 * @brief The instructions of a compiled script: a word with the opcode (and an argument above 8 bits), a word with the line number, then their operands
+	 */
+	enum ScriptOp : uint32_t{
+		/**
+		 * @brief [line]: a line parsed when it runs (a pipeline, a job, an unknown command...), its variables substituted first
+		 */
+		Text = 0,
+		/**
+		 * @brief [line, name, slots...]: a line whose arguments are bound to the slots of its command; the argument is the number of slots
+		 */
+		Bound = 1,
+		/**
+		 * @brief [variable, a, b]: set a variable to a, or to (a op b) where op is the argument, an Arithmetic
+		 */
+		Set = 2,
+		/**
+		 * @brief [a, b, target]: jump to target unless the condition holds; the argument is a Comparison and its flags
+		 */
+		Branch = 3,
+		/**
+		 * @brief [target]: jump to target
+		 */
+		Jump = 4,
+		/**
+		 * @brief [variable, counter, target, words...]: set the variable to the next word of a for loop, or jump to target after the last one
+		 */
+		Next = 5
+	};
+
+	enum Arithmetic : uint32_t{Assign, Add, Subtract, Multiply, Divide, Modulo};
+	enum Comparison : uint32_t{IsTrue, IsEqual, IsNotEqual, IsLess, IsLessEqual, IsGreater, IsGreaterEqual};
+	constexpr uint32_t comparison_not = 1 << 8; //the condition is negated
+	constexpr uint32_t comparison_numbers = 1 << 9; //both sides must be integers, the bounds of a for loop
+
+	/**
+	 * @brief the number of words of each instruction, without the words of a Bound or a Next
+	 */
+	constexpr size_t script_op_size[] = {3, 4, 5, 5, 3, 5};
+
+	/**
+	 * @brief a part of an operand which is a variable has one of these sizes, and the index of the variable as offset:
+	 * its value as it is, or escaped to stay one word in the text of a line, outside of quotes or inside double quotes
+	 */
+	constexpr uint32_t script_variable = ~uint32_t(0), script_word = script_variable - 1, script_quoted = script_variable - 2;
+
+	/**
+	 * @brief a part of an operand which is a text left in the script, not copied into the pool, has this bit in its offset
+	 */
+	constexpr uint32_t script_source = uint32_t(1) << 31;
+
+	/**
+	 * @brief append a value to the text of a line, escaped with the rules of the tokenizer so that it stays one word
+	 * @param quoting: script_word outside of quotes, script_quoted inside double quotes
+	 */
+	void append_escaped(std::string& text, std::string_view value, uint32_t quoting){
+		if(quoting == script_word && value.empty()){
+			text += "''";
+			return;
+		}
+		const char* special = quoting == script_word ? " \t'\"\\=|&" : "\"\\";
+		for(char c : value){
+			if(std::strchr(special, c) != nullptr && c != '\0'){
+				text += '\\';
+			}
+			text += c;
+		}
+	}
+
+	/**
+	 * @brief split a line of a script into its words, with the quotes and the escapes of the command lines but without keyword arguments
+	 */
+	void script_words(std::string_view line, std::vector<std::string>& words){
+		words.clear();
+		size_t i = 0;
+		while(true){
+			while(i < line.size() && (line[i] == ' ' || line[i] == '\t')){
+				++i;
+			}
+			if(i == line.size()){
+				return;
+			}
+			std::string word;
+			while(i < line.size() && line[i] != ' ' && line[i] != '\t'){
+				const char c = line[i++];
+				if(c == '\''){
+					const size_t end = std::min(line.find('\'', i), line.size());
+					word.append(line.substr(i, end - i));
+					i = end + 1;
+				}else if(c == '"'){
+					for(; i < line.size() && line[i] != '"'; ++i){
+						if(line[i] == '\\' && i + 1 < line.size() && (line[i+1] == '"' || line[i+1] == '\\')){
+							++i;
+						}
+						word += line[i];
+					}
+					++i;
+				}else if(c == '\\' && i < line.size()){
+					word += line[i++];
+				}else{
+					word += c;
+				}
+			}
+			i = std::min(i, line.size()); //after a quote which is not closed
+			words.push_back(std::move(word));
+		}
+	}
+
+	/**
+	 * @brief the first word of a line as it's written, a keyword of the scripts if it's not quoted
+	 */
+	inline std::string_view first_word(std::string_view line){
+		const size_t first = line.find_first_not_of(" \t");
+		return line.substr(first, line.find_first_of(" \t", first) - first);
+	}
+
+	inline bool is_variable_name(std::string_view name){
+		return !name.empty() && !std::isdigit(uint8_t(name[0])) && std::all_of(name.begin(), name.end(), [](char c){ return std::isalnum(uint8_t(c)) || c == '_'; });
+	}
+
+	/**
+	 * @brief read an integer, for the arithmetic and the comparisons of the scripts
+	 * @return false if the text is not an integer
+	 */
+	inline bool script_integer(std::string_view text, long long& value){
+		const std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+		return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+	}
+
+	/**
+	 * @brief Compiles a script into its bytecode: the control lines (set, if, else, while, for, end, break, continue) and the variables here,
+	 * the lines of commands bound by CommandManager::compile_script()
+	 * @note the compiled script is a table of words then a pool of the strings they point into. The words: the number of command names,
+	 * of variables, of operands, of parts of operands and of words; the names (offset, size) and their fingerprints (2 words);
+	 * the operands (first part, number of parts); the parts (offset, size) in the pool, or in the script with script_source,
+	 * or (variable, script_variable or its escaped forms); then the instructions.
+	 * An operand is a text where the $name and ${name} of the variables of the script are substituted when it runs; like the tokenizer,
+	 * a '$' in single quotes or after a backslash outside of quotes is kept. Before a line is split into words, its references are
+	 * replaced by a marker (a control character absent from the script), the index of the variable and the marker again,
+	 * so the words carry them wherever the quotes put them. A line kept as text gets the values escaped instead: either way,
+	 * a value is one word, or one part of a word
+	 */
+	class ScriptCompiler{
+		private:
+			enum Kind{If, Else, While, ForIn, ForRange};
+			/**
+			 * @brief An open block, closed by 'end'
+			 */
+			struct Block{
+				Kind kind;
+				size_t line;
+				/**
+				 * @brief where a loop starts again, and the word of the target of its first branch
+				 */
+				size_t head, patch;
+				std::vector<size_t> breaks, continues;
+				/**
+				 * @brief the variable of a for loop over a range
+				 */
+				uint32_t variable;
+				/**
+				 * @brief an 'else if' is closed by the 'end' of its 'if'
+				 */
+				bool chained;
+			};
+
+			const std::string& path;
+			/**
+			 * @brief the script, if the literals of its lines are left there instead of copied into the pool
+			 */
+			std::string_view source;
+			size_t line = 0;
+			std::map<std::string, uint32_t, std::less<>> variables;
+			uint32_t variable_count = 0;
+			std::map<std::string, uint32_t, std::less<>> names;
+			std::vector<uint32_t> name_words;
+			std::map<uint32_t, uint32_t> variable_operands;
+			std::vector<uint32_t> operand_words, part_words;
+			std::vector<uint32_t> code;
+			std::string pool;
+			std::vector<Block> blocks;
+			std::vector<std::string> words;
+			/**
+			 * @brief whether a command of this name is registered: it's run in place of the keyword of the same name
+			 */
+			std::function<bool(std::string_view)> is_command;
+			char marker = 0;
+			/**
+			 * @brief A reference to a variable in a line: where it is, its variable, how it's escaped in the text,
+			 * and whether it follows a backslash kept in double quotes, which would escape its first character
+			 */
+			struct Reference{
+				size_t begin, end;
+				uint32_t variable;
+				uint32_t quoting;
+				bool after_backslash;
+			};
+			/**
+			 * @brief the line given to mark(), its references, and the line with the references marked
+			 */
+			std::string_view raw;
+			std::vector<Reference> references;
+			std::string marked;
+
+			[[noreturn]] void fail(const std::string& message) const{
+				throw Command::CommandException(path + ":" + std::to_string(line) + ": " + message);
+			}
+
+			/**
+			 * @brief call literal(text) and variable(index) for the parts of a word of a marked line
+			 */
+			template<typename L, typename V>
+			void split(std::string_view text, L literal, V variable) const{
+				size_t begin = 0;
+				for(size_t i = text.find(marker); i != std::string_view::npos; i = text.find(marker, begin)){
+					const size_t end = text.find(marker, i + 1);
+					uint32_t index = 0;
+					std::from_chars(text.data() + i + 1, text.data() + end, index);
+					if(i > begin){
+						literal(text.substr(begin, i - begin));
+					}
+					variable(index);
+					begin = end + 1;
+				}
+				if(begin < text.size() || begin == 0){ //an empty text is an empty literal
+					literal(text.substr(begin));
+				}
+			}
+
+			/**
+			 * @brief the reference to a variable of the script at line[i], a '$'
+			 * @return false if it's not one, a '$' kept as it is
+			 */
+			bool reference(std::string_view line, size_t i, Reference& found) const{
+				size_t name = i + 1, end;
+				if(name < line.size() && line[name] == '{'){
+					end = line.find('}', ++name);
+					if(end == std::string_view::npos){
+						return false;
+					}
+				}else{
+					end = name;
+					while(end < line.size() && (std::isalnum(uint8_t(line[end])) || line[end] == '_')){
+						++end;
+					}
+				}
+				auto it = variables.find(line.substr(name, end - name));
+				if(it == variables.end()){
+					return false;
+				}
+				found = Reference{i, end + (line[name - 1] == '{'), it->second, script_word, false};
+				return true;
+			}
+
+			/**
+			 * @brief find the references of a line, with the quotes and the escapes of the tokenizer, and mark them
+			 * @return the marked line, or the line itself if it has no reference
+			 */
+			std::string_view mark(std::string_view line){
+				raw = line;
+				references.clear();
+				enum{Bare, Single, Double} quote = Bare;
+				size_t kept_backslash = std::string_view::npos;
+				for(size_t i = 0; i < line.size(); ++i){
+					const char c = line[i];
+					if(quote == Single){
+						quote = c == '\'' ? Bare : Single;
+					}else if(c == '\\' && i + 1 < line.size() && (quote == Bare || line[i+1] == '"' || line[i+1] == '\\')){
+						++i; //an escaped character
+					}else if(c == '\\'){
+						kept_backslash = i;
+					}else if(c == '"'){
+						quote = quote == Double ? Bare : Double;
+					}else if(c == '\'' && quote == Bare){
+						quote = Single;
+					}else if(c == '$'){
+						Reference found;
+						if(reference(line, i, found)){
+							if(quote == Double){
+								found.quoting = script_quoted;
+								found.after_backslash = kept_backslash + 1 == i;
+							}
+							references.push_back(found);
+							i = found.end - 1;
+						}
+					}
+				}
+				if(references.empty()){
+					return line;
+				}
+				marked.clear();
+				size_t begin = 0;
+				for(const Reference& r : references){
+					marked.append(line.substr(begin, r.begin - begin));
+					marked += marker;
+					marked += std::to_string(r.variable);
+					marked += marker;
+					begin = r.end;
+				}
+				marked.append(line.substr(begin));
+				return marked;
+			}
+
+			/**
+			 * @brief add a part which is a text: where it is in the script if it's borrowed from there, else copied into the pool
+			 */
+			void literal(std::string_view text){
+				if(text.data() >= source.data() && text.data() + text.size() <= source.data() + source.size() && !text.empty()){
+					part_words.push_back(uint32_t(text.data() - source.data()) | script_source);
+				}else{
+					part_words.push_back(uint32_t(pool.size()));
+					pool.append(text);
+				}
+				part_words.push_back(uint32_t(text.size()));
+			}
+
+			/**
+			 * @brief the operand of the line given to mark(), its references substituted in its text, each value escaped to stay one word
+			 */
+			uint32_t line_operand(){
+				operand_words.push_back(uint32_t(part_words.size() / 2));
+				size_t begin = 0;
+				for(const Reference& r : references){
+					if(r.begin > begin){
+						literal(raw.substr(begin, r.begin - begin));
+					}
+					if(r.after_backslash){
+						literal("\\"); //the backslash stays one
+					}
+					part_words.push_back(r.variable);
+					part_words.push_back(r.quoting);
+					begin = r.end;
+				}
+				if(begin < raw.size() || begin == 0){
+					literal(raw.substr(begin));
+				}
+				operand_words.push_back(uint32_t(part_words.size() / 2) - operand_words.back());
+				return uint32_t(operand_words.size() / 2 - 1);
+			}
+
+			uint32_t operand(std::string_view text){
+				operand_words.push_back(uint32_t(part_words.size() / 2));
+				split(text, [this](std::string_view text){
+					literal(text);
+				}, [this](uint32_t variable){
+					part_words.push_back(variable);
+					part_words.push_back(script_variable);
+				});
+				operand_words.push_back(uint32_t(part_words.size() / 2) - operand_words.back());
+				return uint32_t(operand_words.size() / 2 - 1);
+			}
+
+			uint32_t operand(uint32_t variable){
+				auto it = variable_operands.find(variable);
+				if(it != variable_operands.end()){
+					return it->second;
+				}
+				operand_words.push_back(uint32_t(part_words.size() / 2));
+				operand_words.push_back(1);
+				part_words.push_back(variable);
+				part_words.push_back(script_variable);
+				const uint32_t index = uint32_t(operand_words.size() / 2 - 1);
+				variable_operands.emplace(variable, index);
+				return index;
+			}
+
+			uint32_t variable(const std::string& name){
+				if(!is_variable_name(name)){
+					fail("Invalid variable name '" + name + "'.");
+				}
+				return variables.at(name); //declared by the constructor
+			}
+
+			/**
+			 * @brief emit a Branch to a target set later, for the condition made of words[first...]
+			 * @return the position of the target
+			 */
+			size_t branch(size_t first){
+				uint32_t comparison = IsTrue;
+				if(first < words.size() && words[first] == "not"){
+					comparison |= comparison_not;
+					++first;
+				}
+				static const char* const comparisons[] = {"", "==", "!=", "<", "<=", ">", ">="};
+				uint32_t a, b = 0;
+				if(words.size() == first + 1){
+					a = operand(words[first]);
+				}else if(words.size() == first + 3){
+					const auto it = std::find(std::begin(comparisons) + 1, std::end(comparisons), words[first + 1]);
+					if(it == std::end(comparisons)){
+						fail("Invalid comparison '" + words[first + 1] + "', expected one of == != < <= > >=.");
+					}
+					comparison |= uint32_t(it - std::begin(comparisons));
+					a = operand(words[first]);
+					b = operand(words[first + 2]);
+				}else{
+					fail("Invalid condition, expected a value or 'a <comparison> b'.");
+				}
+				emit(Branch, comparison, {a, b, 0});
+				return code.size() - 1;
+			}
+
+			void emit(ScriptOp op, uint32_t argument, std::initializer_list<uint32_t> args){
+				code.push_back(op | argument << 8);
+				code.push_back(uint32_t(line));
+				code.insert(code.end(), args.begin(), args.end());
+			}
+
+			Block& loop(const std::string& keyword){
+				for(auto it = blocks.rbegin(); it != blocks.rend(); ++it){
+					if(it->kind != If && it->kind != Else){
+						return *it;
+					}
+				}
+				fail("'" + keyword + "' outside of a loop.");
+			}
+
+			void close(Block& block){
+				const uint32_t end = uint32_t(code.size());
+				switch(block.kind){
+					case If:
+					case Else:
+						code[block.patch] = end;
+						return;
+					case ForRange: //continue at the increment
+						for(size_t c : block.continues){
+							code[c] = end;
+						}
+						emit(Set, Add, {block.variable, operand(block.variable), operand(std::string_view("1"))});
+						break;
+					default:
+						for(size_t c : block.continues){
+							code[c] = uint32_t(block.head);
+						}
+						break;
+				}
+				emit(Jump, 0, {uint32_t(block.head)});
+				code[block.patch] = uint32_t(code.size());
+				for(size_t b : block.breaks){
+					code[b] = uint32_t(code.size());
+				}
+			}
+
+		public:
+			/**
+			 * @brief declare the variables of a script: the names given to set and to for, anywhere in it
+			 * @param path: the path of the script, for the errors
+			 * @param text: the script
+			 * @param borrow: whether the literals of the lines are left in text, which then outlives the compiled script
+			 * @param is_command: whether a command of this name is registered, the keywords of the same name are then commands
+			 * @throw CommandException if the script has every control character, none is left to mark its variables
+			 */
+			ScriptCompiler(const std::string& path, std::string_view text, bool borrow, std::function<bool(std::string_view)> is_command) :
+				path(path), source(borrow && text.size() < script_source ? text : std::string_view()), is_command(std::move(is_command)){
+				for(char c = 1; c < ' ' && marker == 0; ++c){
+					if(c != '\t' && c != '\n' && c != '\r' && text.find(c) == std::string_view::npos){
+						marker = c;
+					}
+				}
+				if(marker == 0){
+					throw Command::CommandException(path + ": The script has every control character, its variables can't be marked.");
+				}
+				for_each_script_line(text, [this](size_t, std::string_view line){
+					const std::string_view keyword = this->keyword(line);
+					if(keyword != "set" && keyword != "for"){
+						return;
+					}
+					script_words(line, words);
+					if(words.size() > 1){
+						const std::string name = words[1].substr(0, words[0] == "set" ? words[1].find('=') : std::string::npos);
+						if(is_variable_name(name) && variables.emplace(name, variable_count).second){
+							++variable_count;
+						}
+					}
+				});
+			}
+
+			/**
+			 * @brief the keyword of a control line: its first word, unquoted, if it's one of the keywords and no command has its name
+			 * @return an empty view if it's a line of a command
+			 */
+			std::string_view keyword(std::string_view line) const{
+				static const std::string_view keywords[] = {"set", "if", "else", "end", "while", "for", "break", "continue"};
+				const std::string_view word = first_word(line);
+				if(std::find(std::begin(keywords), std::end(keywords), word) == std::end(keywords) || is_command(word)){
+					return {};
+				}
+				return word;
+			}
+
+			/**
+			 * @brief whether a word of a marked line has a variable of the script
+			 */
+			inline bool has_variable(std::string_view word) const { return word.find(marker) != std::string_view::npos; }
+
+			/**
+			 * @brief mark the references to the variables in a line of a command, before it's parsed; text() and bound() then compile it
+			 * @return the line to parse
+			 */
+			inline std::string_view prepare(std::string_view line){ return mark(line); }
+
+			/**
+			 * @brief compile a line if it's a control line (see keyword())
+			 * @return false if it's a line of a command
+			 * @throw CommandException if it's not valid
+			 */
+			bool control(size_t number, std::string_view text){
+				const std::string_view keyword = this->keyword(text);
+				if(keyword.empty()){
+					return false;
+				}
+				line = number;
+				script_words(mark(text), words);
+				if(keyword == "set"){
+					const size_t equal = words.size() > 1 ? words[1].find('=') : std::string::npos;
+					if(equal == std::string::npos){
+						fail("Expected 'set name=value'.");
+					}
+					const uint32_t target = variable(words[1].substr(0, equal));
+					words[1].erase(0, equal + 1);
+					const size_t first_value = words[1].empty() && words.size() > 2 ? 2 : 1;
+					static const char* const arithmetic[] = {"", "+", "-", "*", "/", "%"};
+					if(words.size() == first_value + 1){
+						emit(Set, Assign, {target, operand(words[first_value]), 0});
+					}else if(words.size() == first_value + 3){
+						const auto it = std::find(std::begin(arithmetic) + 1, std::end(arithmetic), words[first_value + 1]);
+						if(it == std::end(arithmetic)){
+							fail("Invalid operator '" + words[first_value + 1] + "', expected one of + - * / %.");
+						}
+						emit(Set, uint32_t(it - std::begin(arithmetic)), {target, operand(words[first_value]), operand(words[first_value + 2])});
+					}else{
+						fail("Invalid value, expected a value or 'a <operator> b' (quote a value with spaces).");
+					}
+				}else if(keyword == "if"){
+					blocks.push_back(Block{If, line, 0, branch(1), {}, {}, 0, false});
+				}else if(keyword == "else"){
+					if(blocks.empty() || blocks.back().kind != If){
+						fail("'else' without 'if'.");
+					}
+					if(words.size() > 1 && words[1] != "if"){
+						fail("Expected 'else' or 'else if <condition>'.");
+					}
+					Block& block = blocks.back();
+					emit(Jump, 0, {0});
+					code[block.patch] = uint32_t(code.size());
+					block.kind = Else;
+					block.patch = code.size() - 1;
+					if(words.size() > 1){
+						blocks.push_back(Block{If, line, 0, branch(2), {}, {}, 0, true});
+					}
+				}else if(keyword == "while"){
+					const size_t head = code.size();
+					blocks.push_back(Block{While, line, head, branch(1), {}, {}, 0, false});
+				}else if(keyword == "for"){
+					if(words.size() >= 3 && words[2] == "in"){
+						const uint32_t target = variable(words[1]), counter = variable_count++;
+						emit(Set, Assign, {counter, operand(std::string_view("0")), 0});
+						const size_t head = code.size();
+						emit(Next, uint32_t(words.size() - 3), {target, counter, 0});
+						const size_t patch = code.size() - 1;
+						for(size_t i = 3; i < words.size(); ++i){
+							code.push_back(operand(words[i]));
+						}
+						blocks.push_back(Block{ForIn, line, head, patch, {}, {}, target, false});
+					}else if(words.size() == 6 && words[2] == "from" && words[4] == "to"){
+						const uint32_t target = variable(words[1]), limit = variable_count++;
+						emit(Set, Assign, {target, operand(words[3]), 0});
+						emit(Set, Assign, {limit, operand(words[5]), 0});
+						const size_t head = code.size();
+						emit(Branch, IsLessEqual | comparison_numbers, {operand(target), operand(limit), 0});
+						blocks.push_back(Block{ForRange, line, head, code.size() - 1, {}, {}, target, false});
+					}else{
+						fail("Expected 'for name in words...' or 'for name from a to b'.");
+					}
+				}else if(words.size() > 1){
+					fail("'" + words[0] + "' takes no argument.");
+				}else if(keyword == "end"){
+					if(blocks.empty()){
+						fail("'end' without a block.");
+					}
+					bool chained;
+					do{
+						chained = blocks.back().chained;
+						close(blocks.back());
+						blocks.pop_back();
+					}while(chained);
+				}else{ //break, continue
+					Block& block = loop(words[0]);
+					emit(Jump, 0, {0});
+					(keyword == "break" ? block.breaks : block.continues).push_back(code.size() - 1);
+				}
+				return true;
+			}
+
+			/**
+			 * @brief compile the prepared line, parsed when it runs
+			 */
+			void text(size_t number){
+				line = number;
+				emit(Text, 0, {line_operand()});
+			}
+
+			/**
+			 * @brief compile the prepared line, whose arguments are bound to the slots of its command
+			 * @param values: the values of the slots, from the marked line
+			 */
+			void bound(size_t number, std::string_view command, uint64_t fingerprint, const Command::Command::Values& values, size_t count){
+				auto it = names.find(command);
+				if(it == names.end()){ //a new command
+					it = names.emplace(std::string(command), uint32_t(names.size())).first;
+					name_words.push_back(uint32_t(pool.size()));
+					name_words.push_back(uint32_t(command.size()));
+					pool.append(command);
+					name_words.push_back(uint32_t(fingerprint));
+					name_words.push_back(uint32_t(fingerprint >> 32));
+				}
+				line = number;
+				emit(Bound, uint32_t(count), {line_operand(), it->second});
+				for(size_t slot = 0; slot < count; ++slot){
+					code.push_back(operand(values[slot]));
+				}
+			}
+
+			/**
+			 * @brief the compiled script, the words then the pool
+			 * @throw CommandException if a block is not closed
+			 */
+			std::string finish(){
+				if(!blocks.empty()){
+					static const char* const kinds[] = {"if", "else", "while", "for", "for"};
+					line = blocks.back().line;
+					fail(std::string("'") + kinds[blocks.back().kind] + "' is not closed by 'end'.");
+				}
+				std::vector<uint32_t> table{uint32_t(names.size()), variable_count, uint32_t(operand_words.size() / 2), uint32_t(part_words.size() / 2), 0};
+				table.insert(table.end(), name_words.begin(), name_words.end());
+				table.insert(table.end(), operand_words.begin(), operand_words.end());
+				table.insert(table.end(), part_words.begin(), part_words.end());
+				table.insert(table.end(), code.begin(), code.end());
+				table[4] = uint32_t(table.size());
+				std::string compiled(table.size() * sizeof(uint32_t), '\0');
+				std::memcpy(&compiled[0], table.data(), compiled.size());
+				return compiled + pool;
+			}
+	};
+
+	/**
+	 * @brief read the compiled script of a file if it's there and still valid
+	 * @return the content of the cache file after its header, or an empty string if the script must be compiled again
+	 */
+	std::string read_compiled(const fs::path& cache, const std::string& path, const ScriptHeader& key){
+		std::ifstream file(cache, std::ios::binary);
+		ScriptHeader header;
+		if(!file.read(reinterpret_cast<char*>(&header), sizeof(header))){
+			return std::string();
+		}
+		if(std::memcmp(header.magic, script_magic, sizeof(script_magic)) != 0 || header.version != script_version || header.path_size != path.size()
+		   || header.size != key.size || header.mtime != key.mtime || header.commands != key.commands || header.code_size > (uint64_t(1) << 40)){
+			return std::string();
+		}
+		std::string stored(path.size(), '\0');
+		std::string code(header.code_size, '\0');
+		if(!file.read(&stored[0], stored.size()) || stored != path || !file.read(&code[0], code.size()) || script_checksum(code) != header.checksum){
+			return std::string();
+		}
+		return code;
+	}
+
+	/**
+	 * @brief write the compiled script of a file into the cache, replacing the previous one at once
+	 * @note the cache is only a shortcut: if it can't be written, the script is compiled again on the next run
+	 */
+	void write_compiled(const fs::path& cache, const std::string& path, ScriptHeader header, const std::string& code){
+		std::memcpy(header.magic, script_magic, sizeof(script_magic));
+		header.version = script_version;
+		header.path_size = uint32_t(path.size());
+		header.code_size = code.size();
+		header.checksum = script_checksum(code);
+		//unique to the process and the thread: two writers never share a temporary file
+#ifndef _WIN32
+		const long long pid = ::getpid();
+#else
+		const long long pid = ::_getpid();
+#endif
+		fs::path temporary = cache;
+		temporary += ".tmp" + std::to_string(pid) + "-" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		{
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(path.data(), path.size());
+			file.write(code.data(), code.size());
+			if(!file){
+				file.close();
+				std::error_code ignored;
+				fs::remove(temporary, ignored);
+				return;
+			}
+		}
+		std::error_code error;
+		fs::rename(temporary, cache, error);
+		if(error){
+			fs::remove(temporary, error);
+		}
+	}
+}
+
+namespace Command{ //Command::CommandManager class implementation
+
+	thread_local const CommandManager::Context* CommandManager::context = nullptr;
+
+	CommandManager::CommandManager(std::string _name, std::istream& _in, std::ostream& _out, std::ostream& _err)
+		: in(_in), out_target(_out), out_sink(_out.rdbuf(), terminal_output(_out) ? OutputSink::Mode::Line : OutputSink::Mode::Full),
+		err_sink(_err.rdbuf(), OutputSink::Mode::Line), out(&out_sink), err(&err_sink), name(_name), current_registry(new Registry()){
+		err_sink.tie(&out_sink);
+		batch = !terminal_input(in);
+		setQuestion(question);
+		if(in.tie() == &_out){ //what a command asks must be visible before it reads the answer
+			in.tie(&out);
+		}
+	}
+	CommandManager::~CommandManager(){
+		pool.reset(); //the running jobs end before their commands are deleted
+		const Registry* last = current_registry.load();
+		for(const auto& entry : last->commands.ordered()){
+			delete entry.second;
+		}
+		delete last;
+		for(const Retired& r : retired){
+			delete r.registry;
+			for(const std::function<void()>& release : r.releases){
+				release();
+			}
+		}
+		flush();
+		if(in.tie() == &out){
+			in.tie(&out_target);
+		}
+	}
+
+	void CommandManager::flush(){
+		out_sink.flush();
+		err_sink.flush();
+	}
+
+	void CommandManager::setBuffering(OutputSink::Mode mode){
+		out_sink.setMode(mode);
+	}
+
+
+	void CommandManager::set_exit_code(int code){
+		if(context != nullptr && context->exit_code != nullptr){
+			*context->exit_code = code;
+		}else{
+			return_value = code;
+		}
+	}
+
+	void CommandManager::setQuestion(const std::string& question){
+		static const std::pair<std::string_view, QuestionSegment::Kind> variables[] = {
+			{"cwd", QuestionSegment::Cwd}, {"status", QuestionSegment::Status}, {"time", QuestionSegment::Time}, {"jobs", QuestionSegment::Jobs}
+		};
+		std::vector<QuestionSegment> segments;
+		auto literal = [&segments](std::string_view text){
+			if(segments.empty() || segments.back().kind != QuestionSegment::Literal){
+				segments.push_back({QuestionSegment::Literal, ""});
+			}
+			segments.back().text += text;
+		};
+		std::string_view q = question;
+		for(size_t i = 0; i < q.size();){
+			size_t percent = q.find('%', i);
+			literal(q.substr(i, percent - i));
+			if(percent == std::string_view::npos){
+				break;
+			}
+			std::string_view rest = q.substr(percent + 1);
+			i = percent + 1;
+			if(rest.substr(0, 4) == "name"){ //the name never changes, it's part of the literal
+				literal(name);
+				i += 4;
+				continue;
+			}
+			if(rest.substr(0, 1) == "%"){
+				literal("%");
+				i += 1;
+				continue;
+			}
+			bool found = false;
+			for(const auto& variable : variables){
+				if(rest.substr(0, variable.first.size()) == variable.first){
+					segments.push_back({variable.second, ""});
+					i += variable.first.size();
+					found = true;
+					break;
+				}
+			}
+			if(!found){ //not a variable, kept as it is
+				literal("%");
+			}
+		}
+		std::lock_guard<std::mutex> lock(question_mutex);
+		this->question = question;
+		compiled_question.segments = std::move(segments);
+	}
+
+	void CommandManager::render_question(std::string& prompt, int status){
+		std::lock_guard<std::mutex> lock(question_mutex);
+		CompiledQuestion& q = compiled_question;
+		for(const QuestionSegment& segment : q.segments){
+			switch(segment.kind){
+				case QuestionSegment::Literal:
+					prompt += segment.text;
+					break;
+				case QuestionSegment::Cwd:{
+#ifndef _WIN32
+					char buffer[4096];
+					if(::getcwd(buffer, sizeof(buffer)) != nullptr){
+						if(q.cwd.compare(buffer) != 0){
+							q.cwd.assign(buffer);
+						}
+						prompt += q.cwd;
+						break;
+					}
+#endif
+					std::error_code ec;
+					q.cwd = fs::current_path(ec).string();
+					prompt += q.cwd;
+					break;
+				}
+				case QuestionSegment::Status:
+					if(status != q.status){
+						q.status = status;
+						q.status_text = std::to_string(status);
+					}
+					prompt += q.status_text;
+					break;
+				case QuestionSegment::Time:{
+					std::time_t now = std::time(nullptr);
+					if(now != q.time){ //formatted once per second at most
+						q.time = now;
+						std::tm local{};
+#ifdef _WIN32
+						localtime_s(&local, &now);
+#else
+						localtime_r(&now, &local);
+#endif
+						char buffer[16];
+						q.time_text.assign(buffer, std::strftime(buffer, sizeof(buffer), "%H:%M:%S", &local));
+					}
+					prompt += q.time_text;
+					break;
+				}
+				case QuestionSegment::Jobs:{
+					size_t jobs = running_jobs.load(std::memory_order_relaxed);
+					if(jobs != q.jobs){
+						q.jobs = jobs;
+						q.jobs_text = std::to_string(jobs);
+					}
+					prompt += q.jobs_text;
+					break;
+				}
+			}
+		}
+	}
+
+
+	void CommandManager::update_registry(const std::function<void(Registry&)>& modify){
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		std::unique_ptr<Registry> next = std::make_unique<Registry>(*current_registry.load()); //the writer pays the copy
+		dropped.clear();
+		modify(*next);
+		next->commands.ordered(); //sorted now, so the readers never modify it
+		retired.push_back(Retired{0, current_registry.exchange(next.release(), std::memory_order_seq_cst), std::move(dropped)});
+		retired.back().epoch = epochs.advance(); //the readers entering from now on see the new registry
+		invalidate_help(); //after the publication, so a table rendered for the new generation sees the new registry
+		dropped.clear();
+		//free the registries nobody can see anymore; the last ones wait for the next modification, a running command may be using them
+		retired.erase(std::remove_if(retired.begin(), retired.end(), [this](const Retired& r){
+			if(!epochs.quiescent(r.epoch)){
+				return false;
+			}
+			delete r.registry;
+			for(const std::function<void()>& release : r.releases){ //a command can remove itself, so it's released with the registry, not at once
+				release();
+			}
+			return true;
+		}), retired.end());
+	}
+
+	void CommandManager::addCommand(Command* c){
+		if(this == c->master) return;
+		addCommands({c});
+	}
+	void CommandManager::addCommands(const std::vector<Command*>& added){
+		update_registry([this, &added](Registry& r){
+			for(Command* c : added){
+				if(this == c->master) continue;
+				r.commands.insert(c->name, c);
+				r.names.insert(c->name);
+				c->master = this;
+			}
+		});
+	}
+	void CommandManager::registerFactory(const std::string& name, const std::string& description, LazyCommand::Factory factory){
+		addCommand(new LazyCommand(name, description, std::move(factory)));
+	}
+	void CommandManager::removeCommand(const std::string& name, Release release){
+		update_registry([this, &name, &release](Registry& r){
+			Command* c = r.commands.erase(name);
+			if(c != nullptr){
+				r.names.erase(name);
+				c->master = nullptr;
+				drop(c, std::move(release));
+			}
+		});
+	}
+	void CommandManager::removeCommand(const char* name, Release release){
+		removeCommand(std::string(name), std::move(release));
+	}
+	void CommandManager::removeCommand(Command* c, Release release){
+		update_registry([this, c, &release](Registry& r){
+			c->master = nullptr;
+			Command* entry = r.commands.erase(c->name); //c, or the lazy command which built it
+			if(entry != nullptr){
+				r.names.erase(c->name);
+				drop(entry, std::move(release));
+			}
+		});
+	}
+	void CommandManager::drop(Command* c, Release release){
+		if(dynamic_cast<LazyCommand*>(c) != nullptr){
+			dropped.push_back([c]{ delete c; });
+		}else if(release){
+			dropped.push_back([c, release = std::move(release)]{ release(c); });
+		}
+	}
+	void CommandManager::rename_command(Command* c, const std::string& name){
+		update_registry([c, &name](Registry& r){
+			Command* entry = r.commands.erase(c->name); //c, or the lazy command which built it
+			if(entry != nullptr){
+				r.names.erase(c->name);
+			}else{
+				entry = c;
+			}
+			entry->name = name;
+			entry->loaded()->name = name;
+			c->name = name;
+			r.commands.insert(name, entry);
+			r.names.insert(name);
+		});
+	}
+
+	Command* CommandManager::getCommand(const std::string& name) const{
+		EpochDomain::Guard guard(epochs);
+		return registry().commands.at(name)->resolve();
+	}
+
+
+	std::vector<std::string> CommandManager::similar(const std::string& name,unsigned int max) const{
+		std::vector<std::string> similar;
+		EpochDomain::Guard guard(epochs);
+		for(const auto& match : registry().names.query(name, max)){ //sorted by distance, so the best match is the first
+			similar.emplace_back(match.second);
+		}
+		return similar;
+	}
+
+
+	class CommandManager::FlushOnReturn{
+		private:
+			CommandManager& manager;
+			const bool outermost;
+		public:
+			explicit FlushOnReturn(CommandManager& _manager)
+				: manager(_manager), outermost(context == nullptr && !_manager.mainloop_running){
+			}
+			~FlushOnReturn(){
+				if(outermost){
+					manager.flush();
+				}
+			}
+	};
+
+	void CommandManager::execute(const InputView& i){
+		FlushOnReturn flush_on_return(*this);
+		run_input(i);
+	}
+	void CommandManager::run_input(const InputView& i){
+		CommandResult result = try_run_input(i);
+		switch(result.error()){
+			case CommandResult::Error::None:
+				return;
+			case CommandResult::Error::NotFound:{
+				std::vector<std::string> similar = this->similar(std::string(i.name()), 2);
+				std::string msg = result.message();
+				if(similar.size() > 0){
+					msg += " Did you mean " + similar[0] + " ?";
+				}
+				output() << msg << '\n';
+				return;
+			}
+			case CommandResult::Error::FileNotFound:
+			case CommandResult::Error::NotAFile:
+			case CommandResult::Error::SpawnFailed:
+			case CommandResult::Error::WaitFailed:
+			case CommandResult::Error::ExitStatus:
+				error() << result.message() << '\n';
+				return;
+			default:
+				result.raise(); //throw if the input doesn't match the usage of the command, or if the command failed
+		}
+	}
+	CommandResult CommandManager::try_execute(const InputView& i){
+		FlushOnReturn flush_on_return(*this);
+		return try_run_input(i);
+	}
+	CommandResult CommandManager::try_run_input(const InputView& i){
+		if(i.name().empty()){
+			return CommandResult();
+		}
+		EpochDomain::Guard guard(epochs); //the command is not deleted while it runs
+		::Command::Command* cmd = registry().commands.find(i.name()); //get the command
+		if(cmd != nullptr){ //the command exists
+			try{
+				cmd = cmd->resolve();
+			}catch(CommandException& e){ //a lazy command whose factory failed
+				CommandResult result(CommandResult::Error::Failed, i.name());
+				result.text = e.what();
+				return result;
+			}
+			return cmd->try_invoke(i);
+		}
+		if(allow_execution){
+			std::vector<std::string> args(i.getArgs().begin(), i.getArgs().end());
+			return run_file(std::string(i.name()), args);
+		}
+		return CommandResult(CommandResult::Error::NotFound, i.name());
+	}
+	CommandResult CommandManager::try_execute(const Input& i){
+		return try_execute(InputView(i));
+	}
+	//true if the line ends with a '&' which is not quoted (a background job); end is its position
+	static bool ends_with_ampersand(std::string_view line, size_t& end){
+		end = line.find_last_not_of(" \t");
+		if(end == std::string_view::npos || line[end] != '&'){
+			return false;
+		}
+		size_t found = InputView::find_unquoted(line, '&');
+		while(found != std::string_view::npos && found < end){
+			found = InputView::find_unquoted(line, '&', found + 1);
+		}
+		return found == end;
+	}
+
+	CommandResult CommandManager::try_execute(const std::string& s){
+		FlushOnReturn flush_on_return(*this);
+		InputView view;
+		return try_run_line(s, view);
+	}
+	CommandResult CommandManager::try_execute(const char* s){
+		FlushOnReturn flush_on_return(*this);
+		InputView view;
+		return try_run_line(s, view);
+	}
+
+	CommandResult CommandManager::try_run_line(std::string_view line, InputView& view){
+		size_t end;
+		const bool background = pool && ends_with_ampersand(line, end);
+		if(background || InputView::find_unquoted(line, '|') != std::string_view::npos){ //the jobs and the pipelines cost more to start than an exception
+			try{
+				run_line(line, view);
+			}catch(CommandException& e){
+				CommandResult result(CommandResult::Error::Failed, {});
+				result.text = e.what();
+				return result;
+			}
+			return CommandResult();
+		}
+		view.assign(line);
+		return try_run_input(view);
+	}
+	void CommandManager::execute(const Input& i){
+		execute(InputView(i));
+	}
+	void CommandManager::execute(const std::string& s){
+		FlushOnReturn flush_on_return(*this);
+		InputView view;
+		run_line(s, view);
+	}
+	void CommandManager::execute(const char* s){
+		FlushOnReturn flush_on_return(*this);
+		InputView view;
+		run_line(s, view);
+	}
+
+	void CommandManager::run_line(std::string_view line, InputView& view){
+		if(pool){
+			size_t end;
+			if(ends_with_ampersand(line, end)){ //run it in background
+				line = line.substr(0, end);
+				line = line.substr(0, line.find_last_not_of(" \t") + 1);
+				size_t id = submit(line);
+				output() << '[' << id << "] " << line << '\n';
+				return;
+			}
+		}
+		if(InputView::find_unquoted(line, '|') != std::string_view::npos){
+			run_pipeline(line);
+			return;
+		}
+		view.assign(line);
+		run_input(view);
+	}
+
+	void CommandManager::run_pipeline(std::string_view line){
+		struct Stage{
+			std::string_view text;
+			InputView view;
+			Command* cmd = nullptr;
+			Command::Kwargs kwargs;
+			std::vector<std::string> args; //for an executable
+			int exit_code = EXIT_SUCCESS;
+			std::string error;
+			std::ostringstream err;
+		};
+		std::vector<Stage> stages;
+		for(size_t start = 0; start <= line.size();){
+			size_t end = std::min(InputView::find_unquoted(line, '|', start), line.size()); //start follows a '|', it's not quoted
+			std::string_view text = line.substr(start, end - start);
+			size_t first = text.find_first_not_of(" \t");
+			text = first == std::string_view::npos ? std::string_view() : text.substr(first, text.find_last_not_of(" \t") - first + 1);
+			stages.emplace_back().text = text;
+			start = end + 1;
+		}
+
+		//everything is bound before anything is started, so a bad usage doesn't leave half a pipeline running
+		EpochDomain::Guard guard(epochs); //until all the stages are done
+		for(Stage& stage : stages){
+			stage.view.assign(stage.text);
+			if(stage.view.name().empty()){
+				throw CommandException("Empty command in the pipeline '" + std::string(line) + "'.");
+			}
+			stage.cmd = registry().commands.find(stage.view.name());
+			if(stage.cmd != nullptr){
+				stage.cmd = stage.cmd->resolve();
+				stage.cmd->bind(stage.view, stage.kwargs);
+			}else if(allow_execution){
+				stage.args.assign(stage.view.getArgs().begin(), stage.view.getArgs().end());
+			}else{
+				throw CommandException("Command '" + std::string(stage.view.name()) + "' not found.");
+			}
+		}
+
+		std::vector<std::unique_ptr<Pipe>> pipes;
+		std::vector<std::unique_ptr<PipeWriter>> writers;
+		std::vector<std::unique_ptr<PipeReader>> readers;
+		std::vector<std::unique_ptr<std::ostream>> outputs;
+		std::vector<std::unique_ptr<std::istream>> inputs;
+		for(size_t k = 0; k + 1 < stages.size(); ++k){
+			pipes.push_back(std::make_unique<Pipe>());
+			writers.push_back(std::make_unique<PipeWriter>(*pipes.back()));
+			readers.push_back(std::make_unique<PipeReader>(*pipes.back()));
+			outputs.push_back(std::make_unique<std::ostream>(writers.back().get()));
+			inputs.push_back(std::make_unique<std::istream>(readers.back().get()));
+		}
+
+		std::istream* first_in = context ? context->in : nullptr; //the pipeline reads what the caller would have read
+		std::ostream& last_out = output();
+		bool* session_stop = context ? context->stop : nullptr; //exit in a pipeline ends the session it comes from
+		const size_t job = context ? context->job : 0; //and wait in a pipeline of a job doesn't wait for it
+		std::vector<std::thread> threads;
+		for(size_t k = 0; k < stages.size(); ++k){
+			threads.emplace_back([&, k]{
+				Stage& stage = stages[k];
+				Context ctx{k == 0 ? first_in : inputs[k-1].get(), k + 1 == stages.size() ? &last_out : outputs[k].get(), &stage.err, &stage.exit_code, session_stop, job};
+				context = &ctx;
+				try{
+					if(stage.cmd != nullptr){
+						stage.cmd->run(stage.kwargs);
+					}else{
+						execute_file(std::string(stage.view.name()), stage.args);
+					}
+				}catch(std::exception& e){
+					stage.error = e.what();
+				}
+				context = nullptr;
+				if(k + 1 < stages.size()){ //end of file for the next command
+					outputs[k]->flush();
+					pipes[k]->close();
+				}
+				if(k > 0){ //the previous command can't block on us anymore
+					pipes[k-1]->abandon();
+				}
+			});
+		}
+		for(std::thread& t : threads){
+			t.join();
+		}
+		last_out.flush();
+
+		//like in a shell, the pipeline ends as its last command: its error is thrown, the ones before are only printed
+		for(size_t k = 0; k < stages.size(); ++k){
+			Stage& stage = stages[k];
+			error() << stage.err.str();
+#ifdef SIGPIPE
+			const bool broken_pipe = stage.exit_code == 128 + SIGPIPE; //stopped because the next command stopped reading, not an error
+#else
+			const bool broken_pipe = false;
+#endif
+			if(k + 1 < stages.size() && !stage.error.empty() && !broken_pipe){
+				error() << stage.error << '\n';
+			}
+		}
+		set_exit_code(stages.back().exit_code);
+		if(!stages.back().error.empty()){
+			throw CommandException(stages.back().error);
+		}
+	}
+
+	void CommandManager::execute_file(const fs::path& executable, const std::vector<std::string>& args){
+		run_file(executable.string(), args).raise();
+	}
+
+	/**
+	 * @brief A compiled script, read from what ScriptCompiler wrote; its strings look at it
+	 */
+	struct CommandManager::Script{
+		/**
+		 * @brief A part of an operand: a text, or a variable if variable is not script_variable, escaped as quoting says
+		 */
+		struct Part{
+			std::string_view text;
+			uint32_t variable;
+			uint32_t quoting;
+		};
+		std::vector<std::string_view> names;
+		std::vector<uint64_t> fingerprints;
+		uint32_t variables = 0;
+		/**
+		 * @brief the operands (first part, number of parts)
+		 */
+		std::vector<std::pair<uint32_t, uint32_t>> operands;
+		std::vector<Part> parts;
+		std::vector<uint32_t> code;
+
+		/**
+		 * @brief read a compiled script, checking each of its indexes and jumps
+		 * @param source: the script, if the compiled script borrows its literals
+		 * @return false if it's malformed
+		 */
+		bool load(std::string_view compiled, std::string_view source = {}){
+			constexpr size_t head_size = 5;
+			if(compiled.size() < head_size * sizeof(uint32_t)){
+				return false;
+			}
+			uint32_t head[head_size];
+			std::memcpy(head, compiled.data(), sizeof(head));
+			const size_t word_count = head[4];
+			if(word_count > compiled.size() / sizeof(uint32_t) || word_count < head_size + 4 * uint64_t(head[0]) + 2 * uint64_t(head[2]) + 2 * uint64_t(head[3])){
+				return false;
+			}
+			std::vector<uint32_t> words(word_count);
+			std::memcpy(words.data(), compiled.data(), word_count * sizeof(uint32_t));
+			const std::string_view pool = compiled.substr(word_count * sizeof(uint32_t));
+			auto in = [](std::string_view text, uint32_t offset, uint32_t size){ return offset <= text.size() && size <= text.size() - offset; };
+			auto in_pool = [&pool, &in](uint32_t offset, uint32_t size){ return in(pool, offset, size); };
+			size_t w = head_size;
+			for(uint32_t i = 0; i < head[0]; ++i, w += 4){
+				if(!in_pool(words[w], words[w+1])){
+					return false;
+				}
+				names.push_back(pool.substr(words[w], words[w+1]));
+				fingerprints.push_back(words[w+2] | uint64_t(words[w+3]) << 32);
+			}
+			variables = head[1];
+			operands.reserve(head[2]);
+			parts.reserve(head[3]);
+			for(uint32_t i = 0; i < head[2]; ++i, w += 2){
+				if(words[w] > head[3] || words[w+1] > head[3] - words[w]){
+					return false;
+				}
+				operands.emplace_back(words[w], words[w+1]);
+			}
+			for(uint32_t i = 0; i < head[3]; ++i, w += 2){
+				if(words[w+1] >= script_quoted){
+					if(words[w] >= variables){
+						return false;
+					}
+					parts.push_back(Part{{}, words[w], words[w+1]});
+					continue;
+				}
+				const std::string_view& text = words[w] & script_source ? source : pool;
+				const uint32_t offset = words[w] & ~script_source;
+				if(!in(text, offset, words[w+1])){
+					return false;
+				}
+				parts.push_back(Part{text.substr(offset, words[w+1]), script_variable, script_variable});
+			}
+			code.assign(words.begin() + w, words.end());
+
+			std::vector<bool> starts(code.size() + 1, false); //where an instruction starts, or the end
+			std::vector<uint32_t> targets;
+			for(size_t pc = 0; pc < code.size();){
+				starts[pc] = true;
+				const uint32_t op = code[pc] & 0xff, argument = code[pc] >> 8;
+				if(op > Next || code.size() - pc < script_op_size[op]){
+					return false;
+				}
+				const uint32_t* i = &code[pc];
+				const size_t size = script_op_size[op] + (op == Bound || op == Next ? argument : 0);
+				if(code.size() - pc < size){
+					return false;
+				}
+				auto operand = [this](uint32_t o){ return o < operands.size(); };
+				bool ok = true;
+				switch(op){
+					case Text:
+						ok = operand(i[2]);
+						break;
+					case Bound:
+						ok = operand(i[2]) && i[3] < names.size() && argument <= ::Command::Command::max_args && std::all_of(i + 4, i + size, operand);
+						break;
+					case Set:
+						ok = i[2] < variables && argument <= Modulo && operand(i[3]) && (argument == Assign || operand(i[4]));
+						break;
+					case Branch:
+						ok = (argument & 0xff) <= IsGreaterEqual && operand(i[2]) && ((argument & 0xff) == IsTrue || operand(i[3]));
+						targets.push_back(i[4]);
+						break;
+					case Jump:
+						targets.push_back(i[2]);
+						break;
+					case Next:
+						ok = i[2] < variables && i[3] < variables && std::all_of(i + 5, i + size, operand);
+						targets.push_back(i[4]);
+						break;
+				}
+				if(!ok){
+					return false;
+				}
+				pc += size;
+			}
+			starts[code.size()] = true;
+			return std::all_of(targets.begin(), targets.end(), [&starts](uint32_t target){ return target < starts.size() && starts[target]; });
+		}
+	};
+
+	void CommandManager::execute_script(const fs::path& path){
+		FlushOnReturn flush_on_return(*this);
+		const std::string name = path.string();
+		Script script;
+		if(script_cache.empty()){ //the lines are left in the mapped file, which is kept until the script ends
+			const MappedFile file(name);
+			const std::string compiled = compile_script(name, file.content(), true);
+			if(!script.load(compiled, file.content())){
+				throw CommandException("The script '" + name + "' could not be compiled.");
+			}
+			run_script(name, script);
+			return;
+		}
+		std::error_code error;
+		ScriptHeader key;
+		key.size = fs::file_size(path, error);
+		if(error){
+			throw CommandException("The script '" + name + "' could not be opened: " + error.message());
+		}
+		key.mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(fs::last_write_time(path, error).time_since_epoch()).count();
+		if(error){
+			throw CommandException("The script '" + name + "' could not be opened: " + error.message());
+		}
+		key.commands = commands_fingerprint();
+		const fs::path absolute = fs::absolute(path, error);
+		if(error){
+			throw CommandException("The script '" + name + "' could not be opened: " + error.message());
+		}
+		char id[17];
+		std::snprintf(id, sizeof(id), "%016llx", (unsigned long long)fnv1a(absolute.string()));
+		const fs::path cache = script_cache / (std::string(id) + ".cmds");
+
+		std::string compiled = read_compiled(cache, name, key);
+		if(compiled.empty() || !script.load(compiled)){ //missing, stale or damaged: compiled again
+			{
+				const MappedFile file(name);
+				compiled = compile_script(name, file.content(), false); //the cache keeps its own copy of the lines
+			}
+			script = Script();
+			if(!script.load(compiled)){
+				throw CommandException("The script '" + name + "' could not be compiled.");
+			}
+			write_compiled(cache, name, key, compiled);
+		}
+		run_script(name, script);
+	}
+
+	void CommandManager::enableScriptCache(const fs::path& directory){
+
+		std::error_code error;
+		fs::create_directories(directory, error);
+		if(error){
+			throw CommandException("The script cache '" + directory.string() + "' could not be created: " + error.message());
+		}
+		script_cache = directory;
+	}
+
+	uint64_t CommandManager::fingerprint(const ::Command::Command& command){
+		uint64_t h = fnv1a(command.usage);
+		for(const std::string& value : command.binding.defaults){ //the defaults are bound into the compiled lines
+			h = fnv1a(value, fnv1a(std::string_view("\0", 1), h));
+		}
+		return h;
+	}
+
+	uint64_t CommandManager::commands_fingerprint() const{
+		EpochDomain::Guard guard(epochs);
+		uint64_t h = fnv1a("");
+		for(const auto& entry : registry().commands.ordered()){
+			h = fnv1a(std::string_view("\0", 1), fnv1a(entry.first, h));
+			const uint64_t command = dynamic_cast<const LazyCommand*>(entry.second) ? 0 : fingerprint(*entry.second);
+			h = fnv1a(std::string_view(reinterpret_cast<const char*>(&command), sizeof(command)), h);
+		}
+		return h;
+	}
+
+	std::string CommandManager::compile_script(const std::string& path, std::string_view text, bool borrow) const{
+		EpochDomain::Guard guard(epochs);
+		const Registry& current = registry();
+		ScriptCompiler compiler(path, text, borrow, [&current](std::string_view name){ return current.commands.find(name) != nullptr; });
+		InputView input;
+		::Command::Command::Values values;
+		std::string rest;
+		for_each_script_line(text, [&](size_t number, std::string_view line){
+			if(compiler.control(number, line)){
+				return;
+			}
+			const std::string_view marked = compiler.prepare(line);
+			size_t end;
+			if(!ends_with_ampersand(line, end) && InputView::find_unquoted(line, '|') == std::string_view::npos){ //a job or a pipeline is not bound
+				input.assign(marked);
+				::Command::Command* command = current.commands.find(input.name());
+				//a lazy command doesn't know its usage before it's built; an unknown keyword prints a warning each time it's bound
+				bool bindable = command != nullptr && dynamic_cast<const LazyCommand*>(command) == nullptr && !compiler.has_variable(input.name());
+				for(const auto& kwarg : input.getKwargs()){
+					bindable = bindable && command->binding.slot(kwarg.first) != ::Command::Command::Binding::npos && !compiler.has_variable(kwarg.first);
+				}
+				rest.clear();
+				if(bindable && command->bind_values(input, values, rest).ok()){
+					compiler.bound(number, input.name(), fingerprint(*command), values, command->args_ordered.size());
+					return;
+				}
+			}
+			compiler.text(number);
+		});
+		return compiler.finish();
+	}
+
+	void CommandManager::run_script(const std::string& path, const Script& script){
+		std::vector<std::string> variables(script.variables);
+		//the values of the operands built from several parts: one per slot of a command, then the two sides of a condition
+		std::vector<std::string> buffers(::Command::Command::max_args + 2);
+		auto value = [&script, &variables](uint32_t operand, std::string& buffer) -> std::string_view{
+			const auto [first, count] = script.operands[operand];
+			if(count == 1 && script.parts[first].quoting == script_variable){ //most of them, without a copy
+				const Script::Part& part = script.parts[first];
+				return part.variable == script_variable ? std::string_view(part.text) : std::string_view(variables[part.variable]);
+			}
+			buffer.clear();
+			for(uint32_t i = first; i < first + count; ++i){
+				const Script::Part& part = script.parts[i];
+				if(part.variable == script_variable){
+					buffer.append(part.text);
+				}else if(part.quoting == script_variable){
+					buffer.append(variables[part.variable]);
+				}else{
+					append_escaped(buffer, variables[part.variable], part.quoting);
+				}
+			}
+			return buffer;
+		};
+		auto fail = [&path](uint32_t line, const std::string& message){
+			throw CommandException(path + ":" + std::to_string(line) + ": " + message);
+		};
+		auto integer = [&fail](uint32_t line, std::string_view text){
+			long long n;
+			if(!script_integer(text, n)){
+				fail(line, "'" + std::string(text) + "' is not an integer.");
+			}
+			return n;
+		};
+		char digits[24];
+		auto set_integer = [&digits](std::string& variable, long long n){
+			variable.assign(digits, std::to_chars(digits, digits + sizeof(digits), n).ptr);
+		};
+
+		//the commands are found again after each change of the commands; a changed usage makes its lines parsed again.
+		//They are only valid while the registry they were found in is the current one: a registry at the same address is a new one
+		//if the generation changed
+		std::vector<::Command::Command*> commands(script.names.size());
+		const Registry* resolved_registry = nullptr;
+		std::uint64_t resolved = ~std::uint64_t(0);
+		InputView input;
+		::Command::Command::Values values;
+		const uint32_t* code = script.code.data();
+		for(size_t pc = 0; pc < script.code.size();){
+			const uint32_t* i = code + pc;
+			const uint32_t argument = i[0] >> 8, line = i[1];
+			switch(i[0] & 0xff){
+				case Text:
+				case Bound:{
+					CommandResult result;
+					::Command::Command* command = nullptr;
+					if((i[0] & 0xff) == Bound){
+						EpochDomain::Guard guard(epochs); //the command is not deleted while it runs
+						const Registry& current = registry();
+						const std::uint64_t generation = help_generation.load(std::memory_order_acquire);
+						if(&current != resolved_registry || generation != resolved){
+							for(size_t k = 0; k < commands.size(); ++k){
+								::Command::Command* found = current.commands.find(script.names[k]);
+								const bool same = found != nullptr && dynamic_cast<const LazyCommand*>(found) == nullptr && fingerprint(*found) == script.fingerprints[k];
+								commands[k] = same ? found : nullptr;
+							}
+							resolved_registry = &current;
+							resolved = generation;
+						}
+						command = commands[i[3]];
+						if(command != nullptr){
+							for(uint32_t slot = 0; slot < argument; ++slot){
+								values[slot] = value(i[4 + slot], buffers[slot]);
+							}
+							result = command->try_run_bound(values);
+						}
+					}
+					if(command == nullptr){
+						result = try_run_line(value(i[2], buffers[0]), input);
+					}
+					if(!result.ok()){
+						fail(line, result.message());
+					}
+					pc += script_op_size[Text] + ((i[0] & 0xff) == Bound ? 1 + argument : 0);
+					break;
+				}
+				case Set:{
+					std::string& variable = variables[i[2]];
+					if(argument == Assign){
+						const std::string_view a = value(i[3], buffers[0]);
+						if(a.data() != variable.data()){
+							variable.assign(a);
+						}
+					}else{
+						const long long a = integer(line, value(i[3], buffers[0])), b = integer(line, value(i[4], buffers[1]));
+						if((argument == Divide || argument == Modulo) && b == 0){
+							fail(line, "Division by zero.");
+						}
+						//wrapping like the unsigned integers, instead of overflowing
+						const unsigned long long ua = (unsigned long long)a, ub = (unsigned long long)b;
+						switch(argument){
+							case Add: set_integer(variable, (long long)(ua + ub)); break;
+							case Subtract: set_integer(variable, (long long)(ua - ub)); break;
+							case Multiply: set_integer(variable, (long long)(ua * ub)); break;
+							case Divide: set_integer(variable, b == -1 ? (long long)(0 - ua) : a / b); break;
+							default: set_integer(variable, b == -1 ? 0 : a % b); break;
+						}
+					}
+					pc += script_op_size[Set];
+					break;
+				}
+				case Branch:{
+					const uint32_t comparison = argument & 0xff;
+					const std::string_view a = value(i[2], buffers[::Command::Command::max_args]);
+					bool holds;
+					if(comparison == IsTrue){
+						holds = !a.empty() && a != "0" && a != "false";
+					}else{
+						const std::string_view b = value(i[3], buffers[::Command::Command::max_args + 1]);
+						long long na, nb;
+						int order;
+						if(argument & comparison_numbers){
+							na = integer(line, a);
+							nb = integer(line, b);
+							order = na < nb ? -1 : na > nb;
+						}else if(script_integer(a, na) && script_integer(b, nb)){ //integers are compared as numbers, the rest as texts
+							order = na < nb ? -1 : na > nb;
+						}else{
+							order = a.compare(b);
+						}
+						switch(comparison){
+							case IsEqual: holds = order == 0; break;
+							case IsNotEqual: holds = order != 0; break;
+							case IsLess: holds = order < 0; break;
+							case IsLessEqual: holds = order <= 0; break;
+							case IsGreater: holds = order > 0; break;
+							default: holds = order >= 0; break;
+						}
+					}
+					pc = holds != bool(argument & comparison_not) ? pc + script_op_size[Branch] : i[4];
+					break;
+				}
+				case Jump:
+					pc = i[2];
+					break;
+				default:{ //Next
+					const long long index = integer(line, variables[i[3]]);
+					if(index < 0 || index >= (long long)argument){
+						pc = i[4];
+						break;
+					}
+					const std::string_view word = value(i[5 + index], buffers[0]);
+					variables[i[2]].assign(word);
+					set_integer(variables[i[3]], index + 1);
+					pc += script_op_size[Next] + argument;
+					break;
+				}
+			}
+		}
+	}
+	CommandResult CommandManager::run_file(const std::string& path, const std::vector<std::string>& args){
+#ifdef _WIN32
+		if(!fs::exists(path)){
+			return CommandResult(CommandResult::Error::FileNotFound, path);
+		}
+		if(!fs::is_regular_file(path)){
+			return CommandResult(CommandResult::Error::NotAFile, path);
+		}
+		flush_stream(output()); //the child writes directly on the console
+		flush_stream(error());
+		std::string cmd = path;
+		for(const auto& arg : args){
+			cmd += " " + arg;
+		}
+		int status = system(cmd.c_str());
+#else
+		struct stat st;
+		if(::stat(path.c_str(), &st) != 0){ //one stat for both checks
+			return CommandResult(CommandResult::Error::FileNotFound, path);
+		}
+		if(!S_ISREG(st.st_mode)){
+			return CommandResult(CommandResult::Error::NotAFile, path);
+		}
+
+		//the arguments are given as they are, without a shell to re-tokenize them
+		std::vector<char*> argv;
+		argv.reserve(args.size() + 3);
+		argv.push_back(const_cast<char*>(path.c_str()));
+		for(const auto& arg : args){
+			argv.push_back(const_cast<char*>(arg.c_str()));
+		}
+		argv.push_back(nullptr);
+
+		//the output of the child goes through pipes, to the out and err streams of the manager
+		//in a pipeline, its input comes from the previous command through a third pipe
+		const bool piped_input = context != nullptr && context->in != nullptr;
+		int out_pipe[2] = {-1, -1}, err_pipe[2] = {-1, -1}, in_pipe[2] = {-1, -1};
+		auto close_all = [&]{
+			for(int fd : {out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1], in_pipe[0], in_pipe[1]}){
+				if(fd >= 0){
+					close(fd);
+				}
+			}
+		};
+		if(pipe2(out_pipe, O_CLOEXEC) != 0 || pipe2(err_pipe, O_CLOEXEC) != 0 || (piped_input && pipe2(in_pipe, O_CLOEXEC) != 0)){
+			CommandResult result(CommandResult::Error::SpawnFailed, path);
+			result.value = errno;
+			close_all();
+			return result;
+		}
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO); //dup2 clears O_CLOEXEC on the copy
+		posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+		if(piped_input){
+			posix_spawn_file_actions_adddup2(&actions, in_pipe[0], STDIN_FILENO);
+		}
+		flush_stream(output()); //what was written before must come before the output of the child
+		flush_stream(error());
+
+		pid_t pid;
+		int spawn_error = posix_spawn(&pid, path.c_str(), &actions, nullptr, argv.data(), environ);
+		if(spawn_error == ENOEXEC){ //no shebang, run it as a shell script like system() did
+			static char shell[] = "/bin/sh";
+			argv.insert(argv.begin(), shell);
+			spawn_error = posix_spawn(&pid, shell, &actions, nullptr, argv.data(), environ);
+		}
+		posix_spawn_file_actions_destroy(&actions);
+		for(int* fd : {&out_pipe[1], &err_pipe[1], &in_pipe[0]}){ //the ends of the child
+			if(*fd >= 0){
+				close(*fd);
+				*fd = -1;
+			}
+		}
+		if(spawn_error != 0){
+			close_all();
+			CommandResult result(CommandResult::Error::SpawnFailed, path);
+			result.value = spawn_error;
+			return result;
+		}
+
+		std::thread feeder;
+		if(piped_input){
+			feeder = std::thread([fd = in_pipe[1], source = input().rdbuf()]{
+				sigset_t mask; //if the child stops reading, write() fails with EPIPE instead of killing the process
+				sigemptyset(&mask);
+				sigaddset(&mask, SIGPIPE);
+				pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+				std::vector<char> buffer(1 << 16);
+				std::streamsize n;
+				bool open = source != nullptr;
+				while(open && (n = source->sgetn(buffer.data(), buffer.size())) > 0){
+					for(std::streamsize done = 0; done < n;){
+						ssize_t w = write(fd, buffer.data() + done, n - done);
+						if(w < 0 && errno == EINTR){
+							continue;
+						}
+						if(w <= 0){
+							open = false;
+							break;
+						}
+						done += w;
+					}
+				}
+				close(fd);
+			});
+			in_pipe[1] = -1; //closed by the feeder
+		}
+		forward_output(out_pipe[0], output(), err_pipe[0], error()); //stream until the child closes its outputs
+
+		int status = 0;
+		while(waitpid(pid, &status, 0) < 0){
+			if(errno != EINTR){
+				CommandResult result(CommandResult::Error::WaitFailed, path);
+				result.value = errno;
+				if(feeder.joinable()){
+					feeder.join();
+				}
+				return result;
+			}
+		}
+		if(feeder.joinable()){
+			feeder.join();
+		}
+		if(WIFEXITED(status)){
+			status = WEXITSTATUS(status);
+		}else if(WIFSIGNALED(status)){
+			status = 128 + WTERMSIG(status); //same convention as the shells
+		}
+#endif
+		set_exit_code(status);
+		if(status != 0){
+			CommandResult result(CommandResult::Error::ExitStatus, path);
+			result.value = status;
+			return result;
+		}
+		return CommandResult();
+	}
+
+	void CommandManager::operator()(const InputView& i){
+		execute(i);
+	}
+	void CommandManager::operator()(Input& i){
+		execute(i);
+	}
+	void CommandManager::operator()(const std::string& s){
+		execute(s);
+	}
+	void CommandManager::operator()(const char* s){
+		execute(s);
+	}
+
+	void CommandManager::printHelp() const{
+		std::shared_ptr<const HelpTable> table = std::atomic_load(&help_table);
+		const std::uint64_t generation = help_generation.load(std::memory_order_acquire);
+		if(table == nullptr || table->generation != generation){ //render it again, the commands changed since
+			std::shared_ptr<HelpTable> rendered = std::make_shared<HelpTable>();
+			rendered->generation = generation;
+			EpochDomain::Guard guard(epochs);
+			const CommandMap& commands = registry().commands;
+			unsigned int max_usage_length = 0;
+			for(const auto& entry : commands.ordered()){ //the lazy commands are not built for the help, their name stands for their usage
+				if(entry.second->loaded()->usage.size() > max_usage_length){
+					max_usage_length = entry.second->loaded()->usage.size();
+				}
+			}
+			for(const auto& entry : commands.ordered()){
+				const Command* cmd = entry.second->loaded();
+				rendered->text += extend(cmd->usage, max_usage_length+4);
+				rendered->text += cmd->description;
+				rendered->text += '\n';
+			}
+			table = std::move(rendered);
+			std::atomic_store(&help_table, table); //a table rendered before a newer change is stale at once, its generation is older
+		}
+		output().write(table->text.data(), table->text.size());
+	}
+
+	void CommandManager::printHelp(const std::string& name) const{
+		std::ostream& out = output();
+		std::shared_ptr<const std::string> block;
+		{
+			EpochDomain::Guard guard(epochs);
+			Command* cmd = registry().commands.find(name);
+			if(cmd != nullptr){
+				block = cmd->resolve()->help();
+			}
+		}
+		if(block != nullptr){
+			out.write(block->data(), block->size());
+		}else{
+			out << "Command '" << name << "' not found." << '\n';
+		}
+	}
+
+#ifndef COMMAND_DISABLE_STATS
+	//a duration in a readable unit
+	static std::string format_duration(uint64_t ns){
+		const char* units[] = {"ns", "us", "ms", "s"};
+		double value = (double)ns;
+		size_t unit = 0;
+		while(value >= 1000 && unit < 3){
+			value /= 1000;
+			unit++;
+		}
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f%s" : "%.2f%s", value, units[unit]);
+		return buffer;
+	}
+
+	void CommandManager::printStats() const{
+		std::ostream& out = output();
+		out << extend("command", 20) << extend("calls", 10) << extend("errors", 10) << extend("p50", 10) << extend("p90", 10) << extend("p99", 10) << "max" << '\n';
+		EpochDomain::Guard guard(epochs);
+		for(const auto& entry : registry().commands.ordered()){
+			CommandStats::Summary s = entry.second->loaded()->getStats().summary();
+			if(s.calls == 0){
+				continue;
+			}
+			out << extend(std::string(entry.first), 20) << extend(std::to_string(s.calls), 10) << extend(std::to_string(s.errors), 10)
+				<< extend(format_duration(s.execute.p50), 10) << extend(format_duration(s.execute.p90), 10) << extend(format_duration(s.execute.p99), 10)
+				<< format_duration(s.execute.max) << '\n';
+		}
+		out.flush();
+	}
+
+	void CommandManager::printStats(const std::string& name) const{
+		std::ostream& out = output();
+		EpochDomain::Guard guard(epochs);
+		Command* cmd = registry().commands.find(name);
+		if(cmd == nullptr){
+			out << "Command '" << name << "' not found." << '\n';
+			return;
+		}
+		cmd = cmd->loaded();
+		CommandStats::Summary s = cmd->getStats().summary();
+		out << name << ": " << s.calls << " calls, " << s.errors << " errors" << '\n';
+		out << extend("", 10) << extend("count", 10) << extend("p50", 10) << extend("p90", 10) << extend("p99", 10) << "max" << '\n';
+		for(const auto& row : {std::make_pair("bind", s.bind), std::make_pair("execute", s.execute)}){
+			const CommandStats::Percentiles& p = row.second;
+			out << extend(row.first, 10) << extend(std::to_string(p.count), 10) << extend(format_duration(p.p50), 10) << extend(format_duration(p.p90), 10)
+				<< extend(format_duration(p.p99), 10) << format_duration(p.max) << '\n';
+		}
+		out.flush();
+	}
+#else
+	void CommandManager::printStats() const{
+		throw CommandException("The statistics are compiled out (COMMAND_DISABLE_STATS).");
+	}
+
+	void CommandManager::printStats(const std::string&) const{
+		throw CommandException("The statistics are compiled out (COMMAND_DISABLE_STATS).");
+	}
+#endif
+
+	int CommandManager::mainloop(){
+		if(batch){
+			return runBatch();
+		}
+		std::string line, prompt;
+		InputView input; //reused for every line, so parsing doesn't allocate once it has grown
+		int status = EXIT_SUCCESS; //the exit code of the previous line, for the question
+		mainloop_running = true;
+		while(mainloop_running){
+			set_exit_code(EXIT_SUCCESS); //we reset the exit code
+			if(pool){
+				reportJobs();
+			}
+			prompt.clear();
+			render_question(prompt, status);
+			out.write(prompt.data(), prompt.size());
+			flush(); //everything the previous line printed is written with the prompt
+			std::getline(in, line);
+			if(in.eof()){ //if the input is closed, we stop the mainloop
+				mainloop_running = false;
+				if(pool){
+					waitJobs();
+				}
+				flush();
+				return EXIT_SUCCESS;
+			}
+			if(line.size() == 0){ //if the line is empty, we continue
+				continue;
+			}
+			try{
+				run_line(line, input);
+				status = get_exit_code();
+			}catch(CommandException& e){
+				err << e.what() << '\n';
+				status = get_exit_code() == EXIT_SUCCESS ? EXIT_FAILURE : get_exit_code();
+			}
+		}
+		if(pool){
+			waitJobs();
+		}
+		flush();
+		return get_exit_code();
+	}
+
+	int CommandManager::run_batch(const std::function<size_t(char*, size_t)>& read){
+		std::vector<char> buffer(1 << 16);
+		size_t begin = 0, end = 0; //the lines not run yet are buffer[begin, end)
+		bool closed = false;
+		InputView input; //reused for every line, like in the mainloop
+		mainloop_running = true;
+		while(mainloop_running){
+			const char* first = buffer.data() + begin;
+			const char* newline = static_cast<const char*>(std::memchr(first, '\n', end - begin));
+			if(newline == nullptr){
+				if(closed){
+					if(begin == end){
+						break;
+					}
+					newline = buffer.data() + end; //the last line has no end of line
+				}else{ //the last line is incomplete: it's moved to the front of the buffer and the next chunk is read after it
+					if(begin > 0){
+						std::memmove(buffer.data(), first, end - begin);
+						end -= begin;
+						begin = 0;
+					}
+					if(end == buffer.size()){ //a line longer than the buffer
+						buffer.resize(2 * buffer.size());
+					}
+					const size_t got = read(buffer.data() + end, buffer.size() - end);
+					closed = got == 0;
+					end += got;
+					continue;
+				}
+			}
+			std::string_view line(first, newline - first);
+			begin = std::min<size_t>(newline - buffer.data() + 1, end);
+			if(!line.empty() && line.back() == '\r'){
+				line.remove_suffix(1);
+			}
+			if(line.empty()){
+				continue;
+			}
+			set_exit_code(EXIT_SUCCESS);
+			if(pool){
+				reportJobs();
+			}
+			try{
+				run_line(line, input);
+			}catch(CommandException& e){
+				err << e.what() << '\n';
+			}
+		}
+		const bool stopped = !mainloop_running;
+		mainloop_running = false;
+		if(pool){
+			waitJobs();
+		}
+		flush();
+		return stopped ? get_exit_code() : EXIT_SUCCESS; //like the mainloop, the end of the input is a success
+	}
+
+	int CommandManager::runBatch(){
+#ifndef _WIN32
+		if(&in == &std::cin && in.rdbuf() == stdin_buffer){ //synchronized with stdio, it would give one byte at a time
+			return runBatch(STDIN_FILENO);
+		}
+#endif
+		std::streambuf* source = in.rdbuf();
+		return run_batch([this, source](char* buffer, size_t n) -> size_t{
+			std::streamsize available = source->in_avail();
+			if(available == 0){ //wait for the stream buffer to be filled, it reads what is ready
+				if(std::streambuf::traits_type::eq_int_type(source->sgetc(), std::streambuf::traits_type::eof())){
+					available = -1;
+				}else{
+					available = std::max<std::streamsize>(source->in_avail(), 1);
+				}
+			}
+			if(available < 0){
+				in.setstate(std::ios::eofbit);
+				return 0;
+			}
+			return size_t(source->sgetn(buffer, std::min<std::streamsize>(available, std::streamsize(n))));
+		});
+	}
+
+#ifndef _WIN32
+	int CommandManager::runBatch(int fd){
+		return run_batch([fd](char* buffer, size_t n) -> size_t{
+			while(true){
+				const ssize_t got = ::read(fd, buffer, n);
+				if(got >= 0){
+					return size_t(got);
+				}
+				if(errno != EINTR){ //an error ends the input, like for std::getline
+					return 0;
+				}
+			}
+		});
+	}
+#endif
+
+	void CommandManager::stopSession(){
+		if(context != nullptr && context->stop != nullptr){
+			*context->stop = true;
+		}else{
+			stopMainloop();
+		}
+	}
+
+	void CommandManager::enableJobs(size_t threads){
+		if(pool){
+			return;
+		}
+		pool = std::make_unique<ThreadPool>(threads);
+		addCommand(new PreDefinedCmd::JobsCommand());
+		addCommand(new PreDefinedCmd::WaitCommand());
+		addCommand(new PreDefinedCmd::FgCommand());
+	}
+
+	void CommandManager::disableJobs(){
+		if(!pool){
+			return;
+		}
+		pool.reset(); //wait for the queued and running jobs
+		reportJobs();
+		for(const char* name : {"jobs", "wait", "fg"}){
+			removeCommand(name, [](Command* c){ delete c; });
+		}
+	}
+
+	size_t CommandManager::submit(std::string_view line){
+		if(!pool){
+			throw CommandException("The background jobs are not enabled.");
+		}
+		std::shared_ptr<Job> job;
+		{
+			std::lock_guard<std::mutex> lock(jobs_mutex);
+			job = std::make_shared<Job>(next_job++, line); //reserved at once, the concurrent submissions get other ids
+		}
+		InputView view(job->line);
+		EpochDomain::Guard guard(epochs);
+		Command* cmd = registry().commands.find(view.name());
+		const bool pipeline = InputView::find_unquoted(line, '|') != std::string_view::npos;
+		if(cmd != nullptr && !pipeline){
+			cmd = cmd->resolve();
+		}
+		std::function<void()> task;
+		if(pipeline){
+			task = [this, job]{ run_pipeline(job->line); };
+		}else if(cmd != nullptr){
+			Command::Kwargs kwargs;
+			cmd->bind(view, kwargs); //the errors of usage are reported now, by the caller
+			task = [this, name = std::string(view.name()), kwargs = std::move(kwargs)]{
+				EpochDomain::Guard guard(epochs); //the command is found again, it may have been removed since
+				Command* cmd = registry().commands.find(name);
+				if(cmd == nullptr){
+					throw CommandException("Command '" + name + "' was removed.");
+				}
+				cmd->resolve()->run(kwargs);
+			};
+		}else if(allow_execution && !view.name().empty()){
+			std::vector<std::string> args(view.getArgs().begin(), view.getArgs().end());
+			task = [this, path = std::string(view.name()), args = std::move(args)]{ execute_file(path, args); };
+		}else{
+			throw CommandException("Command '" + std::string(view.name()) + "' not found.");
+		}
+		{
+			std::lock_guard<std::mutex> lock(jobs_mutex);
+			jobs[job->id] = job;
+		}
+		running_jobs.fetch_add(1, std::memory_order_relaxed);
+		pool->submit([this, job, task = std::move(task)]{
+			{
+				std::lock_guard<std::mutex> lock(job->mutex);
+				job->started = true;
+			}
+			int code = EXIT_SUCCESS;
+			Job::State state = Job::Done;
+			Context ctx{&job->in, &job->out, &job->err, &code, nullptr, job->id};
+			context = &ctx; //the command writes into the buffers of the job
+			try{
+				task();
+			}catch(std::exception& e){
+				job->err << e.what() << '\n';
+				if(code == EXIT_SUCCESS){
+					code = EXIT_FAILURE;
+				}
+			}
+			context = nullptr;
+			if(code != EXIT_SUCCESS){
+				state = Job::Failed;
+			}
+			job->finish(state, code);
+			running_jobs.fetch_sub(1, std::memory_order_relaxed);
+		});
+		return job->id;
+	}
+
+	void CommandManager::finish_job(size_t id, Job& job){
+		{
+			std::lock_guard<std::mutex> lock(jobs_mutex);
+			if(jobs.erase(id) == 0){ //another thread finished it
+				return;
+			}
+		}
+		std::lock_guard<std::mutex> lock(job.mutex);
+		output() << job.out_data;
+		error() << job.err_data;
+		job.out_data.clear();
+		job.err_data.clear();
+		output() << '[' << id << "] " << (job.state == Job::Done ? "Done" : "Failed (" + std::to_string(job.exit_code) + ")") << "\t" << job.line << '\n';
+	}
+
+	void CommandManager::listJobs(){
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		for(const auto& entry : jobs){
+			Job& job = *entry.second;
+			std::lock_guard<std::mutex> job_lock(job.mutex);
+			const char* state = job.state == Job::Running ? "Running" : job.state == Job::Done ? "Done" : "Failed";
+			output() << '[' << entry.first << "] " << extend(state, 10) << job.line << '\n';
+		}
+	}
+
+	std::shared_ptr<Job> CommandManager::await_job(size_t id){
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		auto it = jobs.find(id);
+		if(it == jobs.end()){
+			return nullptr;
+		}
+		if(context == nullptr || context->job == 0){ //not called from a job
+			return it->second;
+		}
+		const size_t self = context->job;
+		if(id == self){
+			throw CommandException("The job " + std::to_string(id) + " can't wait for itself.");
+		}
+		{
+			std::lock_guard<std::mutex> job_lock(it->second->mutex);
+			if(!it->second->started){
+				throw CommandException("The job " + std::to_string(id) + " has not started, the job " + std::to_string(self) + " can't wait for it.");
+			}
+		}
+		for(auto next = it; next != jobs.end() && next->second->awaiting != 0; next = jobs.find(next->second->awaiting)){
+			if(next->second->awaiting == self){
+				throw CommandException("The jobs " + std::to_string(self) + " and " + std::to_string(id) + " would wait for each other.");
+			}
+		}
+		auto waiting = jobs.find(self);
+		if(waiting != jobs.end()){
+			waiting->second->awaiting = id;
+		}
+		return it->second;
+	}
+
+	void CommandManager::stop_awaiting(){
+		if(context == nullptr || context->job == 0){
+			return;
+		}
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		auto waiting = jobs.find(context->job);
+		if(waiting != jobs.end()){
+			waiting->second->awaiting = 0;
+		}
+	}
+
+	void CommandManager::waitJob(size_t id){
+		std::shared_ptr<Job> job = await_job(id);
+		if(job == nullptr){
+			throw CommandException("There is no job " + std::to_string(id) + ".");
+		}
+		wait_finished(id, job);
+	}
+
+	void CommandManager::wait_finished(size_t id, const std::shared_ptr<Job>& job){
+		{
+			std::unique_lock<std::mutex> lock(job->mutex);
+			job->changed.wait(lock, [&]{ return job->state != Job::Running; });
+		}
+		stop_awaiting();
+		finish_job(id, *job);
+	}
+
+	void CommandManager::waitJobs(){
+		std::vector<size_t> ids;
+		{
+			std::lock_guard<std::mutex> lock(jobs_mutex);
+			for(const auto& entry : jobs){
+				if(context == nullptr || context->job != entry.first){ //a job waits for the others
+					ids.push_back(entry.first);
+				}
+			}
+		}
+		for(size_t id : ids){
+			std::shared_ptr<Job> job = await_job(id);
+			if(job != nullptr){ //else another thread finished it
+				wait_finished(id, job);
+			}
+		}
+	}
+
+	void CommandManager::foregroundJob(size_t id){
+		std::shared_ptr<Job> job = await_job(id);
+		if(job == nullptr){
+			throw CommandException("There is no job " + std::to_string(id) + ".");
+		}
+		std::string out_data, err_data;
+		bool running = true;
+		while(running){
+			{
+				std::unique_lock<std::mutex> lock(job->mutex);
+				job->changed.wait(lock, [&]{ return job->state != Job::Running || !job->out_data.empty() || !job->err_data.empty(); });
+				out_data.swap(job->out_data);
+				err_data.swap(job->err_data);
+				running = job->state == Job::Running;
+			}
+			output() << out_data << std::flush; //the output is printed as it comes
+			error() << err_data << std::flush;
+			out_data.clear();
+			err_data.clear();
+		}
+		stop_awaiting();
+		finish_job(id, *job);
+	}
+
+	void CommandManager::reportJobs(){
+		std::vector<std::pair<size_t, std::shared_ptr<Job>>> finished;
+		{
+			std::lock_guard<std::mutex> lock(jobs_mutex);
+			for(const auto& entry : jobs){
+				std::lock_guard<std::mutex> job_lock(entry.second->mutex);
+				if(entry.second->state != Job::Running){
+					finished.push_back(entry);
+				}
+			}
+		}
+		for(auto& entry : finished){
+			finish_job(entry.first, *entry.second);
+		}
+	}
+
+	size_t CommandManager::runningJobs() const{
+		return running_jobs.load(std::memory_order_relaxed);
+	}
+
+	PreDefinedCmd::HelpCommand::HelpCommand(std::ostream& _out)
+		: Command("help", "Prints this help message.","", "help [command]"), out(_out){
+			set_default_value("command", "");
+	}
+	PreDefinedCmd::HelpCommand::~HelpCommand(){
+	}
+	void PreDefinedCmd::HelpCommand::execute(const Kwargs& kwargs){
+		if(kwargs.at("command") == ""){
+			master->printHelp();
+		}else{
+			master->printHelp(kwargs.at("command"));
+		}
+	}
+
+	void PreDefinedCmd::ExitCommand::execute(const Kwargs&){
+		master->stopSession();
+	}
+
+	PreDefinedCmd::StatsCommand::StatsCommand()
+		: Command("stats", "Prints the latency statistics of the commands", "Print the number of calls, of errors and the latency percentiles\nof all the commands, or of the binding and the execution of the given one", "stats [command]"){
+	}
+	void PreDefinedCmd::StatsCommand::execute(const Kwargs& kwargs){
+		if(kwargs.at("command") == ""){
+			master->printStats();
+		}else{
+			master->printStats(kwargs.at("command"));
+		}
+	}
+
+	static size_t parse_job_id(const std::string& s){
+		size_t end = 0;
+		unsigned long id = 0;
+		try{
+			id = std::stoul(s, &end);
+		}catch(std::exception&){
+			end = 0;
+		}
+		if(end == 0 || end != s.size()){
+			throw CommandException("'" + s + "' is not a job id.");
+		}
+		return id;
+	}
+
+	void PreDefinedCmd::JobsCommand::execute(const Kwargs&){
+		master->listJobs();
+	}
+
+	PreDefinedCmd::WaitCommand::WaitCommand()
+		: Command("wait", "Waits for a background job", "Wait for the job with the given id,\nor for all of them if there is no id", "wait [id]"){
+	}
+	void PreDefinedCmd::WaitCommand::execute(const Kwargs& kwargs){
+		if(kwargs.at("id") == ""){
+			master->waitJobs();
+		}else{
+			master->waitJob(parse_job_id(kwargs.at("id")));
+		}
+	}
+
+	void PreDefinedCmd::FgCommand::execute(const Kwargs& kwargs){
+		master->foregroundJob(parse_job_id(kwargs.at("id")));
 	}
 
 }
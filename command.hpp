@@ -4,9 +4,18 @@
 #include <istream>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <array>
+#include <cstdint>
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <mutex>
 
 #include <output.hpp>
 
@@ -21,9 +30,14 @@ namespace fs = std::filesystem;
 
 namespace Command{
 	class Input;
+	class InputView;
 	class Command;
+	class LazyCommand;
 	class CommandManager;
 	class CommandException;
+	class ThreadPool;
+	class Job;
+	class CommandServer;
 
 
 
@@ -31,6 +45,9 @@ namespace Command{
 	 * @brief A command line input, consisting of a command name, a list of arguments and a list of keyword arguments.
 	 */
 	class Input{
+
+		friend class InputView;
+
 		protected:
 			/**
 			 * @brief The command name
@@ -245,12 +262,373 @@ namespace Command{
 			static Input parse(const char* s);
 	};
 
+	/**
+	 * @brief A non-owning command line input; the command name, the arguments and the keyword arguments are views into the parsed line
+	 * @note the parsed line must outlive the InputView. An InputView can be reused for several lines, it will keep its capacity and won't allocate again
+	 * @note the tokens are separated by runs of whitespace; 'single quotes' keep everything, "double quotes" keep everything but \" and \\,
+	 * and a backslash outside quotes escapes the next character. A token with an unquoted '=' is a keyword argument, split on its first '='.
+	 * An unterminated quote runs to the end of the line
+	 */
+	class InputView{
+		public:
+			/**
+			 * @brief A keyword argument, as a pair of views (key, value)
+			 */
+			using Kwarg = std::pair<std::string_view, std::string_view>;
+
+		protected:
+			/**
+			 * @brief The command name
+			 */
+			std::string_view command;
+			/**
+			 * @brief The list of arguments
+			 */
+			std::vector<std::string_view> args;
+			/**
+			 * @brief The list of keyword arguments, in the order they were given
+			 */
+			std::vector<Kwarg> kwargs;
+			/**
+			 * @brief The raw arguments (everything after the command name)
+			 */
+			std::string_view raw_args;
+			/**
+			 * @brief The tokens which had quotes or escapes, once unescaped; the other tokens look at the line
+			 * @note it's reserved to the size of the line before parsing, so it never moves while the views are taken
+			 */
+			std::string arena;
+
+			/**
+			 * @brief make the views into the arena of another InputView look at the same place of this one
+			 */
+			void rebase(const char* from, size_t size);
+
+		public:
+			/**
+			 * @brief Construct a new empty InputView object
+			 */
+			InputView() = default;
+			/**
+			 * @brief Construct a new InputView object by parsing a line
+			 * @param s The line to parse, it must outlive the InputView
+			 */
+			explicit InputView(std::string_view s);
+			/**
+			 * @brief Construct a new InputView object by parsing a line
+			 * @param s The line to parse, it must outlive the InputView
+			 */
+			explicit inline InputView(const std::string& s) : InputView(std::string_view(s)) {}
+			/**
+			 * @brief Construct a new InputView object by parsing a line
+			 * @param s The line (char*) to parse, it must outlive the InputView
+			 */
+			explicit inline InputView(const char* s) : InputView(std::string_view(s)) {}
+			/**
+			 * @brief Construct a new InputView object looking at an Input object
+			 * @param i The Input object to look at, it must outlive the InputView
+			 */
+			explicit InputView(const Input& i);
+			/**
+			 * @brief Copy an InputView; the tokens of its arena are looked at in the copied arena
+			 */
+			InputView(const InputView& i);
+			InputView(InputView&& i) noexcept;
+			InputView& operator=(const InputView& i);
+			InputView& operator=(InputView&& i) noexcept;
+
+			/**
+			 * @brief Parse a new line, reusing the already allocated memory
+			 * @param s The line to parse, it must outlive the InputView
+			 */
+			void assign(std::string_view s);
+			/**
+			 * @brief Empty the InputView, keeping its capacity
+			 */
+			void clear();
+
+			/**
+			 * @brief Get the command name
+			 * @return a view on the command name
+			 */
+			inline std::string_view name() const { return command; }
+			/**
+			 * @brief Get the command name
+			 * @return a view on the command name
+			 */
+			inline std::string_view getCommand() const { return command; }
+			/**
+			 * @brief Get the list of arguments
+			 * @return a vector of views containing the arguments
+			 */
+			inline const std::vector<std::string_view>& getArgs() const { return args; }
+			/**
+			 * @brief Get the list of keyword arguments
+			 * @return a vector of (key, value) views, in the order they were given
+			 * @note if a key is given several times, the last one wins
+			 */
+			inline const std::vector<Kwarg>& getKwargs() const { return kwargs; }
+			/**
+			 * @brief Get the raw arguments
+			 * @return a view on everything after the command name
+			 */
+			inline std::string_view getRawArgs() const { return raw_args; }
+
+			/**
+			 * @brief Get an argument
+			 * @param i The index of the argument
+			 * @return a view on the argument
+			 */
+			inline std::string_view operator[](int i) const { return args.at(i); }
+			/**
+			 * @brief Get a keyword argument
+			 * @param key The key of the keyword argument
+			 * @return a view on the value of the keyword argument
+			 * @throw std::out_of_range if the keyword argument doesn't exist
+			 */
+			std::string_view operator[](std::string_view key) const;
+
+			/**
+			 * @brief tell if a keyword argument exists
+			 * @param key The key of the keyword argument
+			 * @return a boolean indicating whether the keyword argument exists or not
+			 */
+			bool hasKwarg(std::string_view key) const;
+			/**
+			 * @brief tell if an argument exists
+			 * @param i The index of the argument
+			 * @return a boolean indicating whether the argument exists or not
+			 */
+			inline bool hasArg(int i) const { return i >= 0 && size_t(i) < args.size(); }
+
+			/**
+			 * @brief Get number of arguments
+			 * @return a size_t containing the number of arguments
+			 */
+			inline size_t getArgCount() const { return args.size(); }
+			/**
+			 * @brief Get number of keyword arguments
+			 * @return a size_t containing the number of keyword arguments
+			 */
+			inline size_t getKwargCount() const { return kwargs.size(); }
+
+			/**
+			 * @brief Copy the viewed input into an owning Input object
+			 * @return an Input object
+			 */
+			Input toInput() const;
+			/**
+			 * @brief Copy the viewed input into an owning Input object
+			 */
+			inline explicit operator Input() const { return toInput(); }
+
+			/**
+			 * @brief Parse a line into an InputView object
+			 * 
+			 * @param s The line to parse, it must outlive the InputView
+			 * @return an InputView object
+			 */
+			static InputView parse(std::string_view s);
+
+			/**
+			 * @brief find a character outside of the quotes and not escaped, with the same rules as the parsing
+			 * @param s: the line to search
+			 * @param c: the character to find
+			 * @param from: where to start, it must not be inside quotes
+			 * @return the position of the character, or npos
+			 */
+			static size_t find_unquoted(std::string_view s, char c, size_t from = 0);
+	};
+
+#ifndef COMMAND_DISABLE_STATS
+	/**
+	 * @brief The invocation and error counters and the latency histograms (binding and execution) of a command
+	 * @note the histograms are log-linear (HDR-like, 8 sub-buckets per power of two, so about 12% of precision); each thread records
+	 * in its own shard with relaxed atomics, so recording never locks. Define COMMAND_DISABLE_STATS to compile all of this out
+	 */
+	class CommandStats{
+		public:
+			/**
+			 * @brief The percentiles of a histogram, in nanoseconds
+			 */
+			struct Percentiles{
+				std::uint64_t count = 0, p50 = 0, p90 = 0, p99 = 0, max = 0;
+			};
+			/**
+			 * @brief A snapshot of the statistics of a command
+			 */
+			struct Summary{
+				std::uint64_t calls = 0, errors = 0;
+				Percentiles bind, execute;
+			};
+
+			static constexpr size_t sub_buckets = 8;
+			static constexpr size_t buckets = (64 - 2) * sub_buckets;
+			static constexpr size_t max_shards = 16;
+
+		private:
+			struct Histogram{
+				std::array<std::atomic<std::uint64_t>, buckets> counts;
+				std::atomic<std::uint64_t> max;
+				void record(std::uint64_t ns);
+			};
+			struct alignas(64) Shard{
+				std::atomic<std::uint64_t> calls, errors;
+				Histogram bind, execute;
+			};
+			/**
+			 * @brief The shards, allocated by the first thread recording in them
+			 */
+			mutable std::array<std::atomic<Shard*>, max_shards> shards{};
+
+			Shard& shard() const;
+
+		public:
+			CommandStats() = default;
+			/**
+			 * @brief a copied command starts with empty statistics
+			 */
+			inline CommandStats(const CommandStats&) : CommandStats() {}
+			CommandStats& operator=(const CommandStats&) = delete;
+			~CommandStats();
+
+			/**
+			 * @brief record a successful binding of the arguments
+			 */
+			void record_bind(std::uint64_t ns) const;
+			/**
+			 * @brief record an invocation which failed while binding its arguments
+			 */
+			void record_bind_error() const;
+			/**
+			 * @brief record an execution of the command
+			 * @param failed: true if it threw a CommandException
+			 */
+			void record_execute(std::uint64_t ns, bool failed) const;
+
+			/**
+			 * @brief merge the shards
+			 */
+			Summary summary() const;
+
+			/**
+			 * @brief the bucket of a latency
+			 */
+			static size_t bucket(std::uint64_t ns);
+			/**
+			 * @brief the highest latency of a bucket
+			 */
+			static std::uint64_t highest(size_t bucket);
+	};
+#endif
+
+	/**
+	 * @brief The result of an execution that doesn't throw (see CommandManager::try_execute())
+	 * @note the message is only formatted when message() is called; the names it reports are copies, so it can be read
+	 * after the input and the command are gone
+	 */
+	class CommandResult{
+
+		friend class Command;
+		friend class CommandManager;
+
+		public:
+			/**
+			 * @brief What went wrong
+			 */
+			enum class Error{
+				None,
+				NotFound,          //no command has this name, and the files are not executed
+				MissingArgument,   //a required argument is not given
+				NoDefaultValue,    //an optional argument is not given and has no default value
+				TooManyArguments,  //more arguments than the usage accepts
+				FileNotFound,      //the file to execute does not exist
+				NotAFile,          //the file to execute is not a regular file
+				SpawnFailed,       //the file could not be executed
+				WaitFailed,        //the file was executed, but its end could not be waited
+				ExitStatus,        //the file returned a non zero exit status
+				Failed             //the command threw a CommandException
+			};
+
+		protected:
+			/**
+			 * @brief what went wrong
+			 */
+			Error code = Error::None;
+			/**
+			 * @brief the name of the command or of the file, a copy: the line it comes from may be gone when the result is read
+			 */
+			std::string subject;
+			/**
+			 * @brief the name of the argument, for MissingArgument and NoDefaultValue
+			 */
+			std::string argument;
+			/**
+			 * @brief the number of arguments of the usage and of the input, for TooManyArguments
+			 */
+			size_t expected = 0, given = 0;
+			/**
+			 * @brief the exit status for ExitStatus, the errno for SpawnFailed and WaitFailed
+			 */
+			int value = 0;
+			/**
+			 * @brief the message of the exception, for Failed
+			 */
+			std::string text;
+
+			CommandResult(Error code, std::string_view subject, std::string_view argument = {}) : code(code), subject(subject), argument(argument) {}
+
+		public:
+			/**
+			 * @brief a successful result
+			 */
+			CommandResult() = default;
+
+			/**
+			 * @brief true if the execution succeeded
+			 */
+			explicit operator bool() const { return code == Error::None; }
+			bool ok() const { return code == Error::None; }
+			/**
+			 * @brief what went wrong, Error::None if nothing
+			 */
+			Error error() const { return code; }
+			/**
+			 * @brief the exit status of the executed file (0 if it's not a file, or if it succeeded)
+			 */
+			int status() const { return code == Error::ExitStatus ? value : 0; }
+
+			/**
+			 * @brief format the message of the error, the same as the one of the CommandException thrown by the throwing API
+			 * @return the message, empty if the execution succeeded
+			 */
+			std::string message() const;
+			/**
+			 * @brief throw the error as a CommandException, do nothing if the execution succeeded
+			 */
+			void raise() const;
+	};
+
 	/**
 	 * @brief A programmer defined command
 	 */
 	class Command{
 
 		friend class CommandManager;
+		friend class LazyCommand;
+
+		public:
+			using Kwargs = std::map<std::string, std::string>;
+
+			/**
+			 * @brief The maximum number of arguments in the usage of a command
+			 */
+			static constexpr size_t max_args = 64;
+
+			/**
+			 * @brief The values of the arguments of an invocation, by slot (in the order of the usage); they look at the input line
+			 */
+			using Values = std::array<std::string_view, max_args>;
 
 		protected:
 			/**
@@ -286,6 +664,59 @@ namespace Command{
 			 */
 			std::map<std::string, std::string> default_values;
 
+			/**
+			 * @brief The argument binding plan, compiled once from the usage string by parse_usage()
+			 * @note each argument of args_ordered is a slot; the masks have one bit per slot
+			 */
+			struct Binding{
+				/**
+				 * @brief (name, slot) pairs sorted by name, for the name to slot lookup
+				 */
+				std::vector<std::pair<std::string, size_t>> lookup;
+				/**
+				 * @brief The default value of each slot (empty if it has none)
+				 */
+				std::vector<std::string> defaults;
+				/**
+				 * @brief The slots of the required arguments
+				 */
+				std::uint64_t required = 0;
+				/**
+				 * @brief The slots of the optional arguments
+				 */
+				std::uint64_t optional = 0;
+				/**
+				 * @brief The slots having a default value
+				 */
+				std::uint64_t has_default = 0;
+				/**
+				 * @brief true if the last slot is "[args...]", which takes all the remaining arguments
+				 */
+				bool variadic = false;
+
+				/**
+				 * @brief Get the slot of an argument
+				 * @param arg: the name of the argument
+				 * @return the slot of the argument, or npos if it's not an argument of the command
+				 */
+				size_t slot(std::string_view arg) const;
+
+				static constexpr size_t npos = size_t(-1);
+			} binding;
+
+#ifndef COMMAND_DISABLE_STATS
+			/**
+			 * @brief The statistics of the command, recorded by bind() and run()
+			 */
+			CommandStats stats;
+#endif
+
+			/**
+			 * @brief The help of the command (printed by "help <name>"), rendered on its first print, null after a change
+			 * @note read and replaced atomically, the renderings can run on several threads
+			 */
+			mutable std::shared_ptr<const std::string> help_block;
+
 			/**
 			 * @brief Construct a instance of command, but with all settings gived in the constructor
 			 * @param name: A string containing the name of the command
@@ -320,11 +751,75 @@ namespace Command{
 			 */
 			Command(const char* name, const char* description, const char* long_desc, const char* usage);
 
+			/**
+			 * @brief execute the command with the values of its arguments by slot, without building the Kwargs
+			 * @param values: the value of each argument, in the order of the usage
+			 * @note by default, it builds the Kwargs and calls execute(const Kwargs&); a command can override it to use the values directly
+			 */
+			virtual void execute_bound(const Values& values);
+
 		private:
 			/**
 			 * @brief parse the usage string to extract the arguments and keyword arguments
 			 */
 			void parse_usage();
+			/**
+			 * @brief bind the arguments and keyword arguments of an input to the arguments of the command, in one pass
+			 * @param input: the input to bind
+			 * @param kwargs: the container to fill, with one entry per argument of the command
+			 * @throw CommandException if a required argument is missing or if there is too many arguments
+			 */
+			void bind(const InputView& input, Kwargs& kwargs) const;
+			/**
+			 * @brief bind the arguments, without recording any statistics
+			 */
+			void bind_arguments(const InputView& input, Kwargs& kwargs) const;
+			/**
+			 * @brief bind the arguments into their slots, the core of the binding
+			 * @param input: the input to bind
+			 * @param values: filled with the value of each slot
+			 * @param rest: the storage of the value of "[args...]", which joins several arguments
+			 * @return an error if a required argument is missing or if there is too many arguments
+			 */
+			CommandResult bind_values(const InputView& input, Values& values, std::string& rest) const;
+			/**
+			 * @brief execute the command with bound arguments, recording its statistics
+			 * @param kwargs: the bound arguments
+			 */
+			void run(const Kwargs& kwargs);
+			/**
+			 * @brief bind the arguments of an input, then execute the command, recording its statistics
+			 * @param input: the input to bind
+			 * @note the same as bind() then run(), with one clock read less
+			 */
+			void invoke(const InputView& input);
+			/**
+			 * @brief the same as invoke(), but a bad usage or a CommandException of the command is returned instead of thrown
+			 * @param input: the input to bind
+			 */
+			CommandResult try_invoke(const InputView& input);
+			/**
+			 * @brief execute the command with arguments already bound, recording its statistics; a CommandException of the command is returned
+			 * @param values: the value of each slot
+			 */
+			CommandResult try_run_bound(const Values& values);
+			/**
+			 * @brief the command to execute in place of this one: itself, or the one a LazyCommand builds
+			 * @throw CommandException if a LazyCommand can't build its command
+			 */
+			virtual Command* resolve(){ return this; }
+			/**
+			 * @brief the command to describe in place of this one: itself, or the one a LazyCommand has already built, without building it
+			 */
+			virtual Command* loaded(){ return this; }
+			/**
+			 * @brief drop the rendered help of the command, and the help table of its manager
+			 */
+			void changed();
+			/**
+			 * @brief get the help of the command, rendering it if needed
+			 */
+			std::shared_ptr<const std::string> help() const;
 
 		public:
 			/**
@@ -332,8 +827,6 @@ namespace Command{
 			 */
 			CommandManager* master = nullptr;
 
-			using Kwargs = std::map<std::string, std::string>;
-
 			/**
 			 * @brief Construct a new Command object
 			 * 
@@ -370,6 +863,30 @@ namespace Command{
 			 */
 			virtual inline void operator()(const Kwargs& kwargs) final{ execute(kwargs); }
 
+			/**
+			 * @brief Get the stream the command should read its input from
+			 * @return the input stream of the current invocation (the output of the previous command in a pipeline), by default the one of the manager
+			 */
+			std::istream& input() const;
+			/**
+			 * @brief Get the stream the command should write its output to
+			 * @return the output stream of the current invocation (the buffer of the job if it runs in background, the input of the next command in a pipeline), by default the one of the manager
+			 */
+			std::ostream& output() const;
+			/**
+			 * @brief Get the stream the command should write its errors to
+			 * @return the error stream of the current invocation (the buffer of the job if it runs in background), by default the one of the manager
+			 */
+			std::ostream& error() const;
+
+#ifndef COMMAND_DISABLE_STATS
+			/**
+			 * @brief Get the statistics of the command
+			 * @return a constant reference to the statistics of the command
+			 */
+			inline const CommandStats& getStats() const { return stats; }
+#endif
+
 			/**
 			 * @brief Get a constant reference to the name of the command
 			 * 
@@ -399,6 +916,7 @@ namespace Command{
 			 * @brief Set the Name object
 			 * 
 			 * @param name: A string containing the new name of the command
+			 * @note the manager publishes the new name at once, but the command must not be running on another thread
 			 */
 			virtual void setName(const std::string& name) final;
 			/**
@@ -406,26 +924,26 @@ namespace Command{
 			 * 
 			 * @param description: a string containing the new short description of the command
 			 */
-			virtual inline void setDescription(const std::string& description) final { this->description = description; }
+			virtual void setDescription(const std::string& description) final;
 			/**
 			 * @brief Set the long description of the command
 			 * 
 			 * @param long_description: a vector of strings containing the new long description of the command
 			 */
-			virtual inline void setLongDescription(const std::vector<std::string>& long_description) final { this->long_description = long_description; }
+			virtual void setLongDescription(const std::vector<std::string>& long_description) final;
 			/**
 			 * @brief Set the Long Description object
 			 * 
 			 * @param long_description: a string containing the new long description of the command
 			 * @note The string will be split on '\\n' characters
 			 */
-			virtual inline void setLongDescription(const std::string& long_description) final { this->long_description = split(long_description, '\n'); }
+			virtual void setLongDescription(const std::string& long_description) final;
 			/**
 			 * @brief Set the Usage of the command
 			 * @param usage: a string containing the new usage of the command
 			 * @note: this string will be parsed to extract the arguments and keyword arguments
 			 */
-			virtual inline void setUsage(const std::string& usage) final { this->usage = usage; parse_usage(); }
+			virtual void setUsage(const std::string& usage) final;
 
 			/**
 			 * @brief Set a default value for the given argument
@@ -466,24 +984,278 @@ namespace Command{
 	}; // class Command
 
 	/**
-	 * @brief A class that manage the commands; you should make an instance of this class in your main function, then add commands to it
+	 * @brief A command built on its first use: only its name and its short description exist until then
+	 * @note the manager executes, describes and returns (getCommand()) the built command in its place; it keeps the registered name.
+	 * A lazy command belongs to its manager: removing it deletes it, with the command it built
 	 */
+	class LazyCommand : public Command{
+		public:
+			/**
+			 * @brief build the command, with new; it's called once, or again on the next use if it threw
+			 */
+			using Factory = std::function<Command*()>;
 
-	using CommandMap = std::map<std::string, Command*>;
-
+		private:
+			Factory factory;
+			std::atomic<Command*> built{nullptr};
+			std::mutex build_mutex;
 
+			Command* resolve() override;
+			Command* loaded() override;
 
-	namespace PreDefinedCmd{
-		/**
-		 * @brief Command that will print the help of all commands of the CommandManager
-		 * @note to enable this command, you have to use the enableHelp() method
-		 */
-		class HelpCommand : public Command{
-			private:
-				std::ostream& out;
-			public:
-				HelpCommand(std::ostream& _out);
-				~HelpCommand();
+		public:
+			/**
+			 * @brief Construct a lazy command
+			 * @param name: the name of the command
+			 * @param description: the short description of the command, shown by the help until it's built
+			 * @param factory: the function building the command
+			 */
+			LazyCommand(const std::string& name, const std::string& description, Factory factory);
+			LazyCommand(const LazyCommand&) = delete;
+			~LazyCommand();
+
+			/**
+			 * @brief execute the built command, building it if needed
+			 */
+			void execute(const Kwargs& kwargs) override;
+
+			/**
+			 * @brief tell if the command is already built
+			 */
+			inline bool isBuilt() const { return built.load(std::memory_order_acquire) != nullptr; }
+	};
+
+	/**
+	 * @brief compute the edit distance (Levenshtein) between two strings
+	 * @param a: the first string
+	 * @param b: the second string
+	 * @return the minimal number of insertions, deletions and substitutions to go from a to b
+	 */
+	size_t edit_distance(std::string_view a, std::string_view b);
+
+	/**
+	 * @brief An edit distance (Levenshtein) query compiled once, to be compared against many strings
+	 * @note patterns of up to 64 characters use the bit-parallel algorithm of Myers (as formulated by Hyyrö), a few word operations per character of the compared string;
+	 * longer ones fall back to the dynamic programming one. The batch version compares 4 strings at once with AVX2 when the CPU has it
+	 */
+	class EditDistance{
+		private:
+			std::string pattern;
+			/**
+			 * @brief for each byte, the positions where it appears in the pattern
+			 */
+			std::array<std::uint64_t, 256> peq{};
+
+			size_t scalar(std::string_view text) const;
+			void batch4(const std::string_view* texts, size_t* distances) const;
+
+		public:
+			/**
+			 * @brief the longest pattern handled by the bit-parallel algorithm
+			 */
+			static constexpr size_t max_bit_parallel = 64;
+
+			/**
+			 * @brief Compile a query
+			 * @param pattern: the string the others will be compared to
+			 */
+			explicit EditDistance(std::string_view pattern);
+
+			/**
+			 * @brief Compute the edit distance between the pattern and a string
+			 * @param text: the string to compare to the pattern
+			 * @return the edit distance
+			 */
+			size_t operator()(std::string_view text) const;
+			/**
+			 * @brief Compute the edit distances between the pattern and several strings
+			 * @param texts: the strings to compare to the pattern
+			 * @param count: the number of strings
+			 * @param distances: where to write the distances (count values)
+			 */
+			void operator()(const std::string_view* texts, size_t count, size_t* distances) const;
+	};
+
+	/**
+	 * @brief A BK-tree over the command names, answering "names within distance k" queries without comparing against every name
+	 * @note removed names are only marked, the tree is rebuilt when they are more than the living ones
+	 */
+	class NameIndex{
+		public:
+			/**
+			 * @brief A result of a query: (distance, name)
+			 */
+			using Match = std::pair<size_t, std::string_view>;
+
+		private:
+			struct Node{
+				std::string name;
+				bool alive = true;
+				/**
+				 * @brief (distance to this node, child node index) pairs
+				 */
+				std::vector<std::pair<size_t, size_t>> children;
+			};
+			std::vector<Node> nodes;
+			size_t alive = 0;
+
+			/**
+			 * @brief Get the node holding a name
+			 * @return the node index, or npos if the name was never inserted since the last rebuild
+			 */
+			size_t find(std::string_view name) const;
+			/**
+			 * @brief Rebuild the tree with the living names only
+			 */
+			void rebuild();
+
+			static constexpr size_t npos = size_t(-1);
+
+		public:
+			/**
+			 * @brief Add a name to the index (nothing is done if it's already there)
+			 */
+			void insert(std::string_view name);
+			/**
+			 * @brief Remove a name from the index
+			 */
+			void erase(std::string_view name);
+
+			/**
+			 * @brief Get the number of names in the index
+			 */
+			inline size_t size() const { return alive; }
+
+			/**
+			 * @brief Get all the names with an edit distance of at most 'max' with the given name
+			 * @param name: the name to look for
+			 * @param max: the maximum edit distance
+			 * @return the matches, sorted by distance, then by name; the views are valid until the next modification
+			 */
+			std::vector<Match> query(std::string_view name, size_t max) const;
+	};
+
+	/**
+	 * @brief A class that manage the commands; you should make an instance of this class in your main function, then add commands to it
+	 */
+
+	/**
+	 * @brief An open-addressing hash table mapping the command names to the commands, with string_view lookups
+	 * @note it keeps an ordered view of its entries (sorted by name) for the help, rebuilt only after a modification
+	 */
+	class CommandMap{
+		public:
+			/**
+			 * @brief An entry of the ordered view
+			 */
+			using Entry = std::pair<std::string_view, Command*>;
+
+		private:
+			struct Slot{
+				std::string name;
+				Command* command = nullptr;
+				size_t hash = 0;
+				enum : unsigned char { Empty, Used, Erased } state = Empty;
+			};
+			/**
+			 * @brief The slots of the table, their number is always a power of two
+			 */
+			std::vector<Slot> slots;
+			/**
+			 * @brief The number of used slots
+			 */
+			size_t used = 0;
+			/**
+			 * @brief The number of erased slots, they are kept so the probing sequences are not broken
+			 */
+			size_t erased = 0;
+			/**
+			 * @brief The entries sorted by name, rebuilt when needed
+			 */
+			mutable std::vector<Entry> sorted;
+			mutable bool sorted_valid = true;
+
+			/**
+			 * @brief Get the slot of a name
+			 * @return the slot index, or npos if the name is not in the table
+			 */
+			size_t lookup(std::string_view name, size_t hash) const;
+			/**
+			 * @brief Rebuild the table with the given number of slots, dropping the erased slots
+			 */
+			void rehash(size_t capacity);
+
+			static constexpr size_t npos = size_t(-1);
+
+		public:
+			CommandMap() = default;
+			/**
+			 * @brief copy a map; the copy sorts its own entries again
+			 */
+			CommandMap(const CommandMap& other);
+			CommandMap& operator=(const CommandMap& other);
+
+			/**
+			 * @brief Get the command with the given name
+			 * @param name: the name of the command
+			 * @return a pointer to the command, or nullptr if there is none
+			 */
+			Command* find(std::string_view name) const;
+			/**
+			 * @brief Get the command with the given name
+			 * @param name: the name of the command
+			 * @return a pointer to the command
+			 * @throw std::out_of_range if there is no command with this name
+			 */
+			Command* at(std::string_view name) const;
+			/**
+			 * @brief tell if there is a command with the given name
+			 */
+			inline bool contains(std::string_view name) const { return find(name) != nullptr; }
+
+			/**
+			 * @brief Add or replace the command with the given name
+			 * @param name: the name of the command
+			 * @param command: the command
+			 * @return the replaced command, or nullptr if there was none
+			 */
+			Command* insert(std::string_view name, Command* command);
+			/**
+			 * @brief Remove the command with the given name
+			 * @param name: the name of the command
+			 * @return the removed command, or nullptr if there was none
+			 */
+			Command* erase(std::string_view name);
+
+			/**
+			 * @brief Get the number of commands
+			 */
+			inline size_t size() const { return used; }
+			/**
+			 * @brief tell if there is no command
+			 */
+			inline bool empty() const { return used == 0; }
+
+			/**
+			 * @brief Get all the commands sorted by name
+			 * @return a vector of (name, command) pairs, valid until the next modification
+			 */
+			const std::vector<Entry>& ordered() const;
+	};
+
+
+
+	namespace PreDefinedCmd{
+		/**
+		 * @brief Command that will print the help of all commands of the CommandManager
+		 * @note to enable this command, you have to use the enableHelp() method
+		 */
+		class HelpCommand : public Command{
+			private:
+				std::ostream& out;
+			public:
+				HelpCommand(std::ostream& _out);
+				~HelpCommand();
 
 				void execute(const Kwargs& kwargs);
 		};
@@ -500,6 +1272,54 @@ namespace Command{
 				void execute(const Kwargs&) final;
 		};
 
+		/**
+		 * @brief Command that will list the background jobs
+		 * @note to enable this command, you have to use the enableJobs() method
+		 */
+		class JobsCommand : public Command{
+			public:
+				inline JobsCommand() : Command("jobs", "Lists the background jobs", "List the jobs started with a trailing '&',\nwith their state and their command line", "jobs") {}
+				~JobsCommand() = default;
+
+				void execute(const Kwargs&) final;
+		};
+
+		/**
+		 * @brief Command that will wait for a background job, or all of them
+		 * @note to enable this command, you have to use the enableJobs() method
+		 */
+		class WaitCommand : public Command{
+			public:
+				WaitCommand();
+				~WaitCommand() = default;
+
+				void execute(const Kwargs& kwargs) final;
+		};
+
+		/**
+		 * @brief Command that will bring a background job to the foreground, printing its output while it runs
+		 * @note to enable this command, you have to use the enableJobs() method
+		 */
+		class FgCommand : public Command{
+			public:
+				inline FgCommand() : Command("fg", "Brings a background job to the foreground", "Print the output of the job as it comes,\nuntil it's done", "fg <id>") {}
+				~FgCommand() = default;
+
+				void execute(const Kwargs& kwargs) final;
+		};
+
+		/**
+		 * @brief Command that will print the latency statistics of the commands
+		 * @note to enable this command, you have to use the enableStats() method
+		 */
+		class StatsCommand : public Command{
+			public:
+				StatsCommand();
+				~StatsCommand() = default;
+
+				void execute(const Kwargs& kwargs) final;
+		};
+
 		/**
 		 * @brief Command that will print the current working directory
 		 * @note to enable this command, you have to use the enableFs() method
@@ -507,26 +1327,188 @@ namespace Command{
 	}
 
 
+	/**
+	 * @brief Epoch based reclamation, for the snapshots of the command registry
+	 * @note a reader announces the epoch it enters in, in a slot of its own; a writer starts a new epoch after publishing,
+	 * then what the previous epochs could see is freed once no reader of these epochs remains
+	 */
+	class EpochDomain{
+		public:
+			/**
+			 * @brief The number of threads reading at the same time; more threads wait for a free slot
+			 */
+			static constexpr size_t max_readers = 128;
+
+		private:
+			struct alignas(64) Slot{
+				/**
+				 * @brief the epoch of the reader using this slot, 0 if it's free
+				 */
+				std::atomic<std::uint64_t> epoch{0};
+			};
+			std::atomic<std::uint64_t> current{1};
+			Slot readers[max_readers];
+
+		public:
+			/**
+			 * @brief A read-side critical section: what was published when it started is not freed before it ends
+			 */
+			class Guard{
+				private:
+					const EpochDomain& domain;
+					size_t slot;
+				public:
+					explicit Guard(const EpochDomain& domain);
+					~Guard();
+					Guard(const Guard&) = delete;
+					Guard& operator=(const Guard&) = delete;
+			};
+
+			/**
+			 * @brief enter a read-side critical section
+			 * @note re-entrant: a thread holds one slot, its nested sections only count their depth, and the outermost one releases it
+			 * @return the slot to give to exit()
+			 */
+			size_t enter() const;
+			void exit(size_t slot) const;
+
+			/**
+			 * @brief start a new epoch
+			 * @return the new epoch: the readers of the older ones may still see what was published before
+			 */
+			std::uint64_t advance();
+			/**
+			 * @brief true if no reader of an epoch older than the given one remains
+			 */
+			bool quiescent(std::uint64_t epoch) const;
+	};
+
+	/**
+	 * @brief The stream buffer between the CommandManager and its output streams: it batches the writes into a few big ones
+	 * @note in Full mode, it only writes when it's full or flushed, std::endl doesn't flush it;
+	 * in Line mode, it writes at each end of line, for the terminals
+	 */
+	class OutputSink : public std::streambuf{
+		public:
+			enum class Mode{
+				Line,
+				Full
+			};
+
+		private:
+			/**
+			 * @brief the stream buffer to write into
+			 */
+			std::streambuf* target;
+			std::vector<char> buffer;
+			/**
+			 * @brief the number of bytes waiting in the buffer, in Line mode (in Full mode, the buffer is the put area)
+			 */
+			size_t used = 0;
+			Mode mode;
+			/**
+			 * @brief a sink written before this one, so what was written into it comes first (the output sink, for the error sink)
+			 */
+			OutputSink* tied = nullptr;
+
+			/**
+			 * @brief write what is waiting in the buffer to the target, without flushing the target
+			 */
+			void drain();
+
+		protected:
+			int_type overflow(int_type c) override;
+			std::streamsize xsputn(const char* s, std::streamsize n) override;
+			int sync() override;
+
+		public:
+			/**
+			 * @param target: the stream buffer to write into
+			 * @param mode: when to write into the target
+			 * @param capacity: the size of the buffer
+			 */
+			explicit OutputSink(std::streambuf* target, Mode mode = Mode::Full, size_t capacity = 1 << 16);
+			~OutputSink() override;
+
+			void setMode(Mode mode);
+			inline Mode getMode() const { return mode; }
+			inline std::streambuf* getTarget() const { return target; }
+			/**
+			 * @brief flush another sink before each write into this one
+			 */
+			inline void tie(OutputSink* sink){ tied = sink; }
+
+			/**
+			 * @brief write everything to the target, and flush it
+			 */
+			void flush();
+	};
+
 	class CommandManager{
 
+		friend class CommandServer;
+		friend class Command;
+
+		public:
+			/**
+			 * @brief A function called with a removed command once no thread uses it anymore, to delete it for example
+			 */
+			using Release = std::function<void(Command*)>;
+
 		private:
 		
+			/**
+			 * @brief The question (the prompt) as given to setQuestion()
+			 */
 			std::string question = "(%name) ";
+			/**
+			 * @brief A piece of the compiled question: a literal (%name is already replaced in it), or a variable
+			 */
+			struct QuestionSegment{
+				enum Kind : unsigned char { Literal, Cwd, Status, Time, Jobs } kind;
+				std::string text;
+			};
+			/**
+			 * @brief The question compiled by setQuestion(), with the last value of each variable, formatted again only when it changes
+			 */
+			struct CompiledQuestion{
+				std::vector<QuestionSegment> segments;
+				std::string cwd;
+				int status = EXIT_SUCCESS;
+				std::string status_text = "0";
+				std::time_t time = -1;
+				std::string time_text;
+				size_t jobs = 0;
+				std::string jobs_text = "0";
+			} compiled_question;
+			/**
+			 * @brief protect compiled_question, the mainloop and the sessions of a server render it on their own threads
+			 */
+			std::mutex question_mutex;
 			/**
 			 * @brief The input stream of the CommandManager
 			 * @note by default, it's std::cin
 			 */
 			std::istream& in;
 			/**
-			 * @brief The output stream of the CommandManager
+			 * @brief The output stream given to the CommandManager
 			 * @note by default, it's std::cout
 			 */
-			std::ostream& out;
+			std::ostream& out_target;
+			/**
+			 * @brief The buffers of the output and error streams, writing into the streams given at construction
+			 * @note the error sink writes at each end of line, after the output sink, so the errors keep their place in the output
+			 */
+			OutputSink out_sink, err_sink;
 			/**
-			 * @brief The error stream of the CommandManager
-			 * @note by default, it's std::cerr
+			 * @brief The output stream of the CommandManager, buffered by out_sink
+			 * @note mutable, like the references it replaces: writing into it doesn't change the manager
 			 */
-			std::ostream& err;
+			mutable std::ostream out;
+			/**
+			 * @brief The error stream of the CommandManager, buffered by err_sink
+			 */
+			mutable std::ostream err;
 			/**
 			 * @brief The name of the CommandManager
 			 */
@@ -542,13 +1524,215 @@ namespace Command{
 			 */
 			int return_value = EXIT_SUCCESS;
 
-			std::string parse_question();
+			/**
+			 * @brief if true, the mainloop runs the input as a batch (see runBatch())
+			 * @note by default, it's true if the input is not a terminal
+			 */
+			bool batch = false;
+
+			/**
+			 * @brief append the question to a string
+			 * @param prompt: the string to append to
+			 * @param status: the exit code of the previous line, for %status
+			 */
+			void render_question(std::string& prompt, int status);
+
+			/**
+			 * @brief The pool running the background jobs, null while the jobs are not enabled
+			 */
+			std::unique_ptr<ThreadPool> pool;
+			/**
+			 * @brief The background jobs, by id
+			 */
+			std::map<size_t, std::shared_ptr<Job>> jobs;
+			/**
+			 * @brief protect the jobs map
+			 */
+			mutable std::mutex jobs_mutex;
+			/**
+			 * @brief The id of the next job
+			 */
+			size_t next_job = 1;
+			/**
+			 * @brief The number of jobs still running
+			 */
+			std::atomic<size_t> running_jobs{0};
+
+			/**
+			 * @brief execute a line, in background if it ends with '&' and the jobs are enabled
+			 * @param line: the line to execute
+			 * @param view: the InputView to parse the line into
+			 */
+			void run_line(std::string_view line, InputView& view);
+			/**
+			 * @brief execute an input, the core of execute(); the unknown commands and the files which fail are printed, the other errors thrown
+			 */
+			void run_input(const InputView& input);
+			/**
+			 * @brief execute an input, the core of try_execute()
+			 */
+			CommandResult try_run_input(const InputView& input);
+			/**
+			 * @brief Flushes the output when a call from outside of any invocation and of the mainloop returns,
+			 * so what it printed into a fully buffered stream (a file, a std::ostringstream) is there at once
+			 */
+			class FlushOnReturn;
+			/**
+			 * @brief execute a line like run_line(), returning its error instead of printing or throwing it
+			 * @param line: the line to execute
+			 * @param view: the InputView to parse the line into
+			 */
+			CommandResult try_run_line(std::string_view line, InputView& view);
+			/**
+			 * @brief execute a pipeline: each command runs on its own thread, its output streamed to the input of the next one
+			 * @param line: the commands, separated by '|'
+			 * @throw CommandException if one of the commands doesn't match its usage (before starting any of them), or the first error of a command
+			 */
+			void run_pipeline(std::string_view line);
+			/**
+			 * @brief execute a file, the core of execute_file() and try_execute()
+			 * @param path: the path of the file to execute
+			 * @param args: the arguments to give to the file
+			 * @return the result of the execution, its subject is path
+			 */
+			CommandResult run_file(const std::string& path, const std::vector<std::string>& args);
+			/**
+			 * @brief run the lines read by chunks, the core of runBatch()
+			 * @param read: read at most n bytes into a buffer, without waiting for more than what is available; returns 0 at the end of the input
+			 * @return int: the exit code of the batch
+			 */
+			int run_batch(const std::function<size_t(char* buffer, size_t n)>& read);
+			/**
+			 * @brief The directory of the compiled scripts, empty while the cache is disabled
+			 */
+			fs::path script_cache;
+			/**
+			 * @brief a hash of what a compiled line depends on in a command: its usage and its default values
+			 */
+			static std::uint64_t fingerprint(const Command& command);
+			/**
+			 * @brief a hash of the registered commands, a compiled script is only used with the same commands
+			 */
+			std::uint64_t commands_fingerprint() const;
+			/**
+			 * @brief A compiled script, ready to run
+			 */
+			struct Script;
+			/**
+			 * @brief compile a script into its bytecode: its control lines, and its lines of commands, each one bound to the slots of its command
+			 * if the command is known and the arguments match its usage, else kept as text
+			 * @param path: the path of the script, for the errors
+			 * @param text: the script
+			 * @param borrow: whether the literals of the lines are left in text, which then outlives the compiled script (see Script::load),
+			 * else copied into the compiled script, as the cache stores it
+			 * @return the compiled script
+			 * @throw CommandException if a control line is not valid, prefixed by "path:line: "
+			 */
+			std::string compile_script(const std::string& path, std::string_view text, bool borrow) const;
+			/**
+			 * @brief run a compiled script
+			 * @param path: the path of the script, for the errors
+			 * @throw CommandException the error of the first failing line, prefixed by "path:line: "
+			 */
+			void run_script(const std::string& path, const Script& script);
+			/**
+			 * @brief write the output of a finished job and remove it, unless another thread already did
+			 */
+			void finish_job(size_t id, Job& job);
+			/**
+			 * @brief find a job to wait for; called from a job, record that it waits for it
+			 * @return nullptr if there is no job with this id (another thread may have finished it)
+			 * @throw CommandException, called from a job, if it's this job, if it has not started (it may be queued behind this one),
+			 * or if it waits, maybe through other jobs, for this one
+			 */
+			std::shared_ptr<Job> await_job(size_t id);
+			/**
+			 * @brief called from a job, record that it doesn't wait anymore
+			 */
+			void stop_awaiting();
+			/**
+			 * @brief wait for a job found by await_job(), then print its output
+			 */
+			void wait_finished(size_t id, const std::shared_ptr<Job>& job);
+			/**
+			 * @brief rename a command, in one modification of the registry
+			 */
+			void rename_command(Command* command, const std::string& name);
+
+			/**
+			 * @brief The rendered help table (printed by "help"), with the generation of the commands it was rendered from
+			 */
+			struct HelpTable{
+				std::uint64_t generation;
+				std::string text;
+			};
+			/**
+			 * @brief The last rendered help table, read and replaced atomically; it's stale if its generation is not help_generation
+			 */
+			mutable std::shared_ptr<const HelpTable> help_table;
+			/**
+			 * @brief Incremented by each change of the commands shown in the help table (added, removed, renamed, described, built)
+			 */
+			std::atomic<std::uint64_t> help_generation{0};
+
+			inline void invalidate_help(){ help_generation.fetch_add(1, std::memory_order_acq_rel); }
 
 		protected:
 			/**
-			 * @brief The map containing all the commands of the CommandManager
+			 * @brief The commands of the CommandManager; a published registry is never modified, a writer publishes a modified copy
+			 */
+			struct Registry{
+				/**
+				 * @brief The map containing all the commands of the CommandManager
+				 */
+				CommandMap commands;
+				/**
+				 * @brief The index of the command names, used to find similar names
+				 */
+				NameIndex names;
+			};
+			/**
+			 * @brief The readers of the registry, they keep it alive while they use it
+			 */
+			mutable EpochDomain epochs;
+
+			/**
+			 * @brief Get the current registry
+			 * @note it's only valid while a guard of epochs is alive: EpochDomain::Guard guard(epochs);
+			 */
+			inline const Registry& registry() const { return *current_registry.load(std::memory_order_seq_cst); }
+
+		private:
+			std::atomic<const Registry*> current_registry;
+			/**
+			 * @brief serialize the writers of the registry
+			 */
+			std::mutex registry_mutex;
+			/**
+			 * @brief A previous registry, with the epoch after which no new reader can see it, and the release of the commands it was the last to hold
+			 */
+			struct Retired{
+				std::uint64_t epoch;
+				const Registry* registry;
+				std::vector<std::function<void()>> releases;
+			};
+			std::vector<Retired> retired;
+			/**
+			 * @brief The releases of the commands removed by the modification in progress, run with the registry they are removed from
+			 */
+			std::vector<std::function<void()>> dropped;
+
+			/**
+			 * @brief publish a modified copy of the registry; the previous ones are freed once no thread can use them, it never waits for the readers
+			 * @param modify: the modification, applied to the copy
+			 */
+			void update_registry(const std::function<void(Registry&)>& modify);
+			/**
+			 * @brief release a command removed by the modification in progress, with the registry it's removed from
 			 */
-			CommandMap commands;
+			void drop(Command* command, Release release);
+
+		protected:
 			/**
 			 * @brief true if the mainloop is running, false otherwise
 			 */
@@ -561,42 +1745,116 @@ namespace Command{
 			 * @param in: the input stream of the CommandManager (can be a file (ifstream))
 			 * @param out: the output stream of the CommandManager (can be a file (ofstream))
 			 * @param err: the error stream of the CommandManager (can be a file (ofstream))
+			 * @note the output is buffered (see setBuffering()), what is written directly into out can come before it
 			 */
 			CommandManager(std::string name = "main", std::istream& in = std::cin, std::ostream& out = std::cout, std::ostream& err = std::cerr);
 			~CommandManager();
 
-			inline void set_exit_code(int code) { return_value = code; }
+			/**
+			 * @brief The streams and the exit code of an invocation of a command, when they are not the ones of the manager
+			 * @note a null input means the input of the manager
+			 */
+			struct Context{
+				std::istream* in;
+				std::ostream* out;
+				std::ostream* err;
+				int* exit_code;
+				/**
+				 * @brief set by the exit command to end the session of a server instead of the mainloop, null outside of a session
+				 */
+				bool* stop = nullptr;
+				/**
+				 * @brief the id of the background job running the invocation, 0 if it's not a job; a job doesn't wait for itself
+				 */
+				size_t job = 0;
+			};
+			/**
+			 * @brief The context of the invocation running on this thread, or null
+			 */
+			static thread_local const Context* context;
+
+			/**
+			 * @brief set the exit code of the current invocation (the one of the job if it runs in background)
+			 */
+			void set_exit_code(int code);
 			inline int get_exit_code() const { return return_value; }
+
+			/**
+			 * @brief Get the input stream of the current invocation
+			 * @return the output of the previous command if the current one is in a pipeline, or the input stream of the manager
+			 */
+			inline std::istream& input() const { return context && context->in ? *context->in : in; }
+			/**
+			 * @brief Get the output stream of the current invocation
+			 * @return the stream of the job or of the pipeline running on this thread, or the output stream of the manager
+			 */
+			inline std::ostream& output() const { return context ? *context->out : out; }
+			/**
+			 * @brief Get the error stream of the current invocation
+			 * @return the stream of the job or of the pipeline running on this thread, or the error stream of the manager
+			 */
+			inline std::ostream& error() const { return context ? *context->err : err; }
+
+			/**
+			 * @brief write what is buffered in the output and error streams of the CommandManager
+			 * @note the mainloop does it before each prompt, and execute(), try_execute() and execute_script() when they return to a caller outside of any command
+			 */
+			void flush();
+			/**
+			 * @brief choose when the output of the CommandManager is written
+			 * @param mode: Line to write at each end of line, Full to write only when the buffer is full or flushed
+			 * @note by default, it's Line if the output is a terminal, Full otherwise (a file or a pipe)
+			 */
+			void setBuffering(OutputSink::Mode mode);
 			
 
 			/**
 			 * @brief Add a command to the CommandManager
 			 * @param command: a pointer to the command to add
+			 * @note it can be called while other threads execute commands; it copies the registry, prefer addCommands() for many commands
 			 */
 			void addCommand(Command* command);
+			/**
+			 * @brief Add several commands to the CommandManager, with one copy of the registry
+			 * @param commands: pointers to the commands to add
+			 */
+			void addCommands(const std::vector<Command*>& commands);
+			/**
+			 * @brief Add a command built on its first execution or its first "help <name>" (see LazyCommand)
+			 * @param name: the name of the command
+			 * @param description: the short description of the command, for the help
+			 * @param factory: the function building the command, with new
+			 * @note to register many of them at once, give the LazyCommand objects to addCommands()
+			 */
+			void registerFactory(const std::string& name, const std::string& description, LazyCommand::Factory factory);
 			/**
 			 * @brief remove the command with the given name from the CommandManager
 			 * @param name: the name of the command to remove
+			 * @param release: called with the command once no thread executes it anymore; it's then the caller's again
+			 * @note it doesn't wait for the threads executing the command: the release runs after a later modification of the commands,
+			 * or when the manager is destroyed. A lazy command is deleted by the manager, and its release is not called
 			 */
-			void removeCommand(const std::string& name);
+			void removeCommand(const std::string& name, Release release = nullptr);
 			/**
-			 * @brief remove the given command from the CommandManager
-			 * @param command: a pointer to the command to remove
+			 * @brief remove the command with the given name from the CommandManager
+			 * @param name: the name of the command to remove
+			 * @param release: called with the command once no thread executes it anymore
 			 */
-			void removeCommand(const char* name);
+			void removeCommand(const char* name, Release release = nullptr);
 			/**
 			 * @brief remove the given command from the CommandManager
 			 * @param command: a pointer to the command to remove
+			 * @param release: called with the command once no thread executes it anymore
 			 */
-			void removeCommand(Command* command);
+			void removeCommand(Command* command, Release release = nullptr);
 
 			/**
 			 * @brief get the command with the given name
 			 * 
 			 * @param name: the name of the command to get
-			 * @return a pointer to the command with the given name
+			 * @return a pointer to the command with the given name (for a lazy command, the one it builds)
 			 */
-			inline Command* getCommand(const std::string& name) const { return commands.at(name); }
+			Command* getCommand(const std::string& name) const;
 
 			/**
 			 * @brief return the command with the given name
@@ -611,7 +1869,7 @@ namespace Command{
 			 * 
 			 * @param name: the name of the command to find
 			 * @param max: the maximum number of differences between the given name and the name of the commands
-			 * @return a vector of strings containing the names of the commands found
+			 * @return a vector of strings containing the names of the commands found, the closest first
 			 */
 			std::vector<std::string> similar(const std::string& name, unsigned int max = 5) const;
 
@@ -619,7 +1877,12 @@ namespace Command{
 			 * @brief execute one of the commands of the CommandManager where the name of the input is matching the name of the command
 			 * @param input: the input to interpret and execute
 			 */
-			void execute(Input input);
+			void execute(const InputView& input);
+			/**
+			 * @brief execute one of the commands of the CommandManager where the name of the input is matching the name of the command
+			 * @param input: the input to interpret and execute
+			 */
+			void execute(const Input& input);
 			/**
 			 * @brief execute one of the commands of the CommandManager where the name of the input is matching the name of the command
 			 * @param s: the string to interpret and execute
@@ -633,6 +1896,32 @@ namespace Command{
 			 */
 			void execute(const char* s);
 
+			/**
+			 * @brief execute one of the commands of the CommandManager, without throwing on a bad input
+			 * @param input: the input to interpret and execute
+			 * @return the result of the execution
+			 * @note an unknown command, a bad usage, a file that can't be executed and a CommandException of the command are returned;
+			 * the other exceptions of the command are still thrown
+			 */
+			CommandResult try_execute(const InputView& input);
+			/**
+			 * @brief execute one of the commands of the CommandManager, without throwing on a bad input
+			 * @param input: the input to interpret and execute
+			 * @return the result of the execution
+			 */
+			CommandResult try_execute(const Input& input);
+			/**
+			 * @brief execute a line, without throwing on a bad input
+			 * @param s: the line to interpret and execute, it can be a pipeline or a background job
+			 * @return the result of the execution
+			 */
+			CommandResult try_execute(const std::string& s);
+			/**
+			 * @brief execute a line, without throwing on a bad input
+			 * @param s: the line to interpret and execute, it can be a pipeline or a background job
+			 * @return the result of the execution
+			 */
+			CommandResult try_execute(const char* s);
 
 			/**
 			 * @brief execute the file with the given name
@@ -640,7 +1929,34 @@ namespace Command{
 			 * @param args: the arguments to give to the file
 			 */
 			void execute_file(const fs::path& filename, const std::vector<std::string>& args = {});
+			/**
+			 * @brief execute a script: a file of commands of this CommandManager, one per line, with variables and control lines
+			 * @param path: the path of the script
+			 * @note the script is compiled before it runs: its control lines (set, if, else, while, for, end, break, continue) into jumps,
+			 * and its lines of commands bound to the slots of their command, so a loop doesn't parse its lines again.
+			 * The keywords of the control lines are reserved unless a command has their name, which is then run in their place.
+			 * Empty lines and lines starting with '#' are skipped. Without a cache (see enableScriptCache()), the compiled lines point into
+			 * the mapped file until the script ends, so the file must not be truncated while it runs; the cache copies them instead
+			 * into the compiled script it stores
+			 * @throw CommandException if the file can't be read, if a control line is not valid, or the error of the first failing line
+			 * (a command not found included), prefixed by "path:line: "
+			 */
+			void execute_script(const fs::path& path);
+			/**
+			 * @brief keep the compiled scripts in a directory: execute_script() then skips the parsing and the binding of the scripts already run
+			 * @param directory: the directory of the cache, created if needed
+			 * @note a compiled script is keyed by the path, the size and the modification time of the script, and by the registered commands;
+			 * a stale one is compiled again. A line of a pipeline or a job, or not matching a command, is still parsed when it runs
+			 * @throw CommandException if the directory can't be created
+			 */
+			void enableScriptCache(const fs::path& directory);
+			inline void disableScriptCache(){ script_cache.clear(); }
 
+			/**
+			 * @brief execute one of the commands of the CommandManager where the name of the input is matching the name of the command
+			 * @param input: the input to interpret and execute
+			 */
+			void operator()(const InputView& input);
 			/**
 			 * @brief execute one of the commands of the CommandManager where the name of the input is matching the name of the command
 			 * @param input: the input to interpret and execute
@@ -662,6 +1978,7 @@ namespace Command{
 			/**
 			 * @brief print the help of the CommandManager
 			 * @note it will print the usage and the description of all the commands
+			 * @note the table is rendered once, and again only after the commands change; it's written in one write
 			 */
 			void printHelp() const;
 			/**
@@ -676,9 +1993,11 @@ namespace Command{
 			 * @brief set the question of the CommandManager
 			 * @param question: the question of the CommandManager
 			 * @note by default, it's "(%name)"
-			 * @note you can use "%name" to print the name of the CommandManager
+			 * @note you can use "%name" to print the name of the CommandManager, "%cwd" the current directory, "%status" the exit code of the previous line,
+			 * "%time" the time (HH:MM:SS) and "%jobs" the number of running background jobs; "%%" prints a '%'
+			 * @note the question is compiled here, printing it only appends its pieces
 			*/
-			inline void setQuestion(const std::string& question) { this->question = question; }
+			void setQuestion(const std::string& question);
 
 			/**
 			 * @brief enable the help command
@@ -698,16 +2017,112 @@ namespace Command{
 			 */
 			inline void disableExit() { removeCommand("exit"); }
 
+			/**
+			 * @brief enable the stats command
+			 */
+			inline void enableStats() { addCommand(new PreDefinedCmd::StatsCommand()); }
+			/**
+			 * @brief disable the stats command
+			 */
+			inline void disableStats() { removeCommand("stats"); }
+
+			/**
+			 * @brief print the statistics of the commands
+			 * @note it will print the number of calls, of errors and the execution latency percentiles of all the commands called at least once
+			 */
+			void printStats() const;
+			/**
+			 * @brief print the statistics of a command
+			 * @param name: the name of the command
+			 * @note it will print the number of calls, of errors, and the latency percentiles of the binding and of the execution
+			 */
+			void printStats(const std::string& name) const;
+
+			/**
+			 * @brief enable the background jobs: a line ending with '&' will be run by a pool of threads, and the jobs, wait and fg commands are added
+			 * @param threads: the number of threads of the pool (0 for one per core)
+			 */
+			void enableJobs(size_t threads = 0);
+			/**
+			 * @brief disable the background jobs, after waiting for the running ones
+			 */
+			void disableJobs();
+
+			/**
+			 * @brief start a line in background
+			 * @param line: the line to execute, without the trailing '&'
+			 * @return the id of the job
+			 * @throw CommandException if the jobs are not enabled or if the line doesn't match the usage of the command
+			 */
+			size_t submit(std::string_view line);
+			/**
+			 * @brief print the background jobs and their state
+			 */
+			void listJobs();
+			/**
+			 * @brief wait for a background job, then print its output
+			 * @param id: the id of the job
+			 * @throw CommandException if there is no job with this id; called from a job, if it's this job, if it has not started,
+			 * or if the two jobs would wait for each other
+			 */
+			void waitJob(size_t id);
+			/**
+			 * @brief wait for all the background jobs, then print their output
+			 * @note called from a job, it waits for all the other ones, and throws as waitJob() if it can't wait for one of them
+			 */
+			void waitJobs();
+			/**
+			 * @brief print the output of a background job as it comes, until it's done
+			 * @param id: the id of the job
+			 * @throw CommandException as waitJob()
+			 */
+			void foregroundJob(size_t id);
+			/**
+			 * @brief print the output of the finished jobs and forget them
+			 */
+			void reportJobs();
+			/**
+			 * @brief Get the number of jobs still running
+			 */
+			size_t runningJobs() const;
+
 			/**
 			 * @brief enter in the mainloop of the CommandManager
 			 * @note it will read the input and execute the command corresponding to the input while we call stopMainloop()
+			 * @note in batch mode (see setBatch()), it's runBatch()
 			 * @return int: the exit code of the mainloop
 			 */
 			int mainloop();
+			/**
+			 * @brief run every line of the input, without prompt, until its end or stopMainloop()
+			 * @note the input is read by large chunks straight from its stream buffer (from the file descriptor 0 for std::cin,
+			 * so what was already read from stdin through stdio is not seen), and the lines are parsed where they are read;
+			 * a command reading the input of the manager only gets what comes after the chunks already read
+			 * @return int: the exit code, like mainloop()
+			 */
+			int runBatch();
+#ifndef _WIN32
+			/**
+			 * @brief run every line read from a file descriptor, without prompt, until its end or stopMainloop()
+			 * @param fd: the file descriptor to read, it's not closed
+			 * @return int: the exit code, like mainloop()
+			 */
+			int runBatch(int fd);
+#endif
+			/**
+			 * @brief choose whether the mainloop prompts for each line or runs the input as a batch
+			 * @note by default, it runs a batch if the input is not a terminal (a file or a pipe)
+			 */
+			inline void setBatch(bool enabled){ batch = enabled; }
+			inline bool isBatch() const { return batch; }
 			/**
 			 * @brief stop the mainloop of the CommandManager
 			 */
 			inline void stopMainloop() { mainloop_running = false; }
+			/**
+			 * @brief stop what runs the current invocation: its session if it comes from a CommandServer, the mainloop otherwise
+			 */
+			void stopSession();
 
 
 			inline void enable_executable(){ allow_execution = true; }
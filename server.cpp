@@ -0,0 +1,326 @@
+#include "server.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace{ //the streams of the sessions
+
+	/**
+	 * @brief The stream buffer of a session: what the commands write waits in a string until the event loop sends it
+	 */
+	class SessionBuffer : public std::streambuf{
+		private:
+			std::string& pending;
+		protected:
+			int_type overflow(int_type c) override{
+				if(!traits_type::eq_int_type(c, traits_type::eof())){
+					pending.push_back(traits_type::to_char_type(c));
+				}
+				return traits_type::not_eof(c);
+			}
+			std::streamsize xsputn(const char* s, std::streamsize n) override{
+				pending.append(s, n);
+				return n;
+			}
+		public:
+			explicit SessionBuffer(std::string& pending) : pending(pending) {}
+	};
+}
+
+namespace Command{ //Command::CommandServer class implementation
+
+	struct CommandServer::Session{
+		int fd;
+		/**
+		 * @brief what the client sent after its last complete line
+		 */
+		std::string received;
+		/**
+		 * @brief the output waiting for the client, from the byte sent
+		 */
+		std::string pending;
+		size_t sent = 0;
+		SessionBuffer buffer{pending};
+		std::ostream out{&buffer};
+		/**
+		 * @brief the input of the commands: they can't read the socket, it's the one of the event loop
+		 */
+		std::istream in{nullptr};
+		InputView view; //reused for every line, as in the mainloop
+		int exit_code = EXIT_SUCCESS;
+		/**
+		 * @brief set by the exit command
+		 */
+		bool stop = false;
+		/**
+		 * @brief the client has closed its side
+		 */
+		bool closing = false;
+		uint32_t events = EPOLLIN;
+
+		explicit Session(int fd) : fd(fd) {}
+		~Session(){ ::close(fd); }
+
+		inline size_t waiting() const { return pending.size() - sent; }
+	};
+
+	CommandServer::CommandServer(CommandManager& _manager, const std::string& _path, mode_t mode)
+		: manager(_manager), path(_path){
+		bool bound = false; //then the socket file is ours, and removed on failure
+		auto fail = [this, &bound](const std::string& what){
+			std::string msg = "The server could not " + what + " '" + path + "': " + std::strerror(errno);
+			for(int fd : {listener, epoll, wakeup}){
+				if(fd >= 0){
+					::close(fd);
+				}
+			}
+			if(bound){
+				::unlink(path.c_str());
+			}
+			throw CommandException(msg);
+		};
+
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if(path.empty() || path.size() >= sizeof(address.sun_path)){
+			throw CommandException("The socket path '" + path + "' is empty or too long.");
+		}
+		std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+		struct stat st;
+		if(::lstat(path.c_str(), &st) == 0){ //a socket left by a previous run is replaced, nothing else
+			if(!S_ISSOCK(st.st_mode)){
+				throw CommandException("The file '" + path + "' already exists and is not a socket.");
+			}
+			::unlink(path.c_str());
+		}
+
+		listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(listener < 0){
+			fail("create the socket");
+		}
+		if(::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0){
+			fail("bind the socket");
+		}
+		bound = true;
+		if(::chmod(path.c_str(), mode) != 0){ //before listen(), so nobody connects with the default permissions
+			fail("set the permissions of");
+		}
+		if(::listen(listener, SOMAXCONN) != 0){
+			fail("listen on");
+		}
+
+		epoll = ::epoll_create1(EPOLL_CLOEXEC);
+		wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(epoll < 0 || wakeup < 0){
+			fail("create the event loop of");
+		}
+		for(int fd : {listener, wakeup}){
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.fd = fd;
+			if(::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0){
+				fail("watch");
+			}
+		}
+	}
+
+	CommandServer::~CommandServer(){
+		sessions.clear(); //closes their sockets
+		for(int fd : {listener, epoll, wakeup}){
+			if(fd >= 0){
+				::close(fd);
+			}
+		}
+		::unlink(path.c_str());
+	}
+
+	void CommandServer::run(){
+		running = true;
+		epoll_event events[64];
+		while(running){
+			int n = ::epoll_wait(epoll, events, 64, -1);
+			if(n < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				throw CommandException(std::string("The server could not wait for its clients: ") + std::strerror(errno));
+			}
+			for(int k = 0; k < n; ++k){
+				const int fd = events[k].data.fd;
+				if(fd == wakeup){
+					uint64_t count;
+					while(::read(wakeup, &count, sizeof(count)) > 0){}
+					continue;
+				}
+				if(fd == listener){
+					accept_all();
+					continue;
+				}
+				auto it = sessions.find(fd);
+				if(it == sessions.end()){
+					continue;
+				}
+				Session& session = *it->second;
+				bool alive = !(events[k].events & EPOLLERR);
+				if(alive && (events[k].events & (EPOLLIN | EPOLLHUP))){
+					alive = receive(session);
+				}
+				if(alive){
+					alive = send_pending(session);
+				}
+				if(alive && (session.stop || session.closing) && session.waiting() == 0){
+					alive = false; //everything was sent, the session is over
+				}
+				if(alive){
+					update_events(session);
+				}else{
+					close_session(fd);
+				}
+			}
+		}
+	}
+
+	void CommandServer::stop(){
+		running = false;
+		uint64_t one = 1;
+		if(::write(wakeup, &one, sizeof(one)) < 0){
+			//the counter is already set, the loop will wake up anyway
+		}
+	}
+
+	void CommandServer::accept_all(){
+		while(true){
+			int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if(fd < 0){
+				return; //EAGAIN once all the clients are accepted; the other errors concern the client only
+			}
+			auto session = std::make_unique<Session>(fd);
+			epoll_event event{};
+			event.events = session->events;
+			event.data.fd = fd;
+			if(::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0){
+				continue; //the session closes its socket
+			}
+			manager.render_question(session->pending, EXIT_SUCCESS); //the output of a session appends to pending, the question can too
+			Session& s = *session;
+			sessions.emplace(fd, std::move(session));
+			if(!send_pending(s)){
+				close_session(fd);
+			}else{
+				update_events(s);
+			}
+		}
+	}
+
+	bool CommandServer::receive(Session& session){
+		if(session.stop || session.closing){
+			return true; //what it sends now is ignored
+		}
+		char buffer[1 << 16];
+		ssize_t n = ::read(session.fd, buffer, sizeof(buffer)); //one read per event, so a client can't starve the others
+		if(n < 0){
+			return errno == EINTR || errno == EAGAIN;
+		}
+		if(n == 0){ //the client has closed its side, its last line can lack its '\n'
+			session.closing = true;
+			if(!session.received.empty()){
+				std::string line = std::move(session.received);
+				session.received.clear();
+				execute(session, line);
+			}
+			return true;
+		}
+		session.received.append(buffer, n);
+
+		size_t start = 0;
+		for(size_t end; !session.stop && (end = session.received.find('\n', start)) != std::string::npos; start = end + 1){
+			std::string_view line(session.received.data() + start, end - start);
+			if(!line.empty() && line.back() == '\r'){
+				line.remove_suffix(1);
+			}
+			if(!line.empty()){
+				execute(session, line);
+			}
+			if(!session.stop){
+				manager.render_question(session.pending, session.exit_code);
+			}
+		}
+		session.received.erase(0, start);
+		if(session.received.size() > max_line){
+			session.out << "The line is too long (more than " << max_line << " bytes).\n";
+			session.stop = true;
+		}
+		return true;
+	}
+
+	void CommandServer::execute(Session& session, std::string_view line){
+		session.exit_code = EXIT_SUCCESS;
+		CommandManager::Context ctx{&session.in, &session.out, &session.out, &session.exit_code, &session.stop};
+		struct Scope{ //the commands write into the session, and set its exit code
+			const CommandManager::Context* previous = CommandManager::context;
+			Scope(const CommandManager::Context* ctx){ CommandManager::context = ctx; }
+			~Scope(){ CommandManager::context = previous; }
+		} scope(&ctx);
+		bool failed = true;
+		try{
+			manager.run_line(line, session.view);
+			failed = false;
+		}catch(CommandException& e){
+			session.out << e.what() << '\n';
+		}catch(std::exception& e){ //a session must not take the server down
+			session.out << "Error: " << e.what() << '\n';
+		}
+		if(failed && session.exit_code == EXIT_SUCCESS){ //for %status
+			session.exit_code = EXIT_FAILURE;
+		}
+	}
+
+	bool CommandServer::send_pending(Session& session){
+		while(session.waiting() > 0){
+			ssize_t n = ::send(session.fd, session.pending.data() + session.sent, session.waiting(), MSG_NOSIGNAL | MSG_DONTWAIT);
+			if(n < 0){
+				if(errno == EINTR){
+					continue;
+				}
+				return errno == EAGAIN || errno == EWOULDBLOCK; //the rest waits for EPOLLOUT
+			}
+			session.sent += n;
+		}
+		session.pending.clear();
+		session.sent = 0;
+		return true;
+	}
+
+	void CommandServer::update_events(Session& session){
+		uint32_t events = 0;
+		if(session.waiting() > 0){
+			events |= EPOLLOUT;
+		}
+		if(!session.stop && !session.closing && session.waiting() < max_pending){
+			events |= EPOLLIN;
+		}
+		if(events != session.events){
+			epoll_event event{};
+			event.events = events;
+			event.data.fd = session.fd;
+			::epoll_ctl(epoll, EPOLL_CTL_MOD, session.fd, &event);
+			session.events = events;
+		}
+	}
+
+	void CommandServer::close_session(int fd){
+		::epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+		sessions.erase(fd);
+	}
+
+}
@@ -0,0 +1,122 @@
+#ifndef __server_hpp__
+#define __server_hpp__
+
+#ifndef __linux__
+#error "server.hpp requires Linux (the sessions are driven by epoll)"
+#endif
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+
+#include "command.hpp"
+
+namespace Command{
+
+	/**
+	 * @brief Serves the commands of a CommandManager to many clients over a Unix domain socket
+	 * @note each client gets its own session: its prompt, its output and error streams, and its exit code;
+	 * one thread drives all of them with epoll, so a command blocks every session while it runs
+	 * @note the exit command ends the session that runs it, not the server
+	 *
+	 * Example:
+	 * @code
+	 * Command::CommandManager manager("daemon");
+	 * manager.enableExit();
+	 * Command::CommandServer server(manager, "/run/daemon.sock");
+	 * server.run(); //until server.stop() is called from another thread
+	 * @endcode
+	 */
+	class CommandServer{
+		private:
+			struct Session;
+
+			CommandManager& manager;
+			/**
+			 * @brief The path of the socket, removed when the server is destroyed
+			 */
+			std::string path;
+			int listener = -1;
+			int epoll = -1;
+			/**
+			 * @brief An eventfd written by stop(), to wake up the event loop
+			 */
+			int wakeup = -1;
+			/**
+			 * @brief The sessions, by file descriptor
+			 */
+			std::map<int, std::unique_ptr<Session>> sessions;
+			std::atomic<bool> running{false};
+
+			/**
+			 * @brief accept the waiting clients, and send them their first prompt
+			 */
+			void accept_all();
+			/**
+			 * @brief read what a client sent, and execute its complete lines
+			 * @return false if the session has to be closed
+			 */
+			bool receive(Session& session);
+			/**
+			 * @brief execute a line in the context of a session
+			 */
+			void execute(Session& session, std::string_view line);
+			/**
+			 * @brief write what is waiting in the output of a session, without blocking
+			 * @return false if the client is gone
+			 */
+			bool send_pending(Session& session);
+			/**
+			 * @brief watch a session for what it's waiting for: more input, or room to write its output
+			 */
+			void update_events(Session& session);
+			void close_session(int fd);
+
+		public:
+			/**
+			 * @brief The longest line a client can send; a longer one ends its session
+			 */
+			static constexpr size_t max_line = 1 << 16;
+			/**
+			 * @brief When the output waiting for a client is bigger, its input is not read until the client catches up
+			 */
+			static constexpr size_t max_pending = 1 << 20;
+
+			/**
+			 * @brief Create the socket and start listening on it
+			 * @param manager: the manager whose commands are served
+			 * @param path: the path of the socket; a file already there is replaced
+			 * @param mode: the permissions of the socket, only its owner can connect by default
+			 * @throw CommandException if the socket can't be created
+			 */
+			CommandServer(CommandManager& manager, const std::string& path, mode_t mode = 0600);
+			CommandServer(const CommandServer&) = delete;
+			CommandServer& operator=(const CommandServer&) = delete;
+			/**
+			 * @brief Close the sessions and remove the socket
+			 */
+			~CommandServer();
+
+			/**
+			 * @brief run the event loop, until stop() is called
+			 */
+			void run();
+			/**
+			 * @brief stop the event loop
+			 * @note it can be called from any thread, or by a command
+			 */
+			void stop();
+
+			inline const std::string& getPath() const { return path; }
+			/**
+			 * @brief the number of connected clients
+			 * @note only meaningful on the thread running the event loop
+			 */
+			inline size_t sessionCount() const { return sessions.size(); }
+	};
+}
+
+#endif
@@ -0,0 +1,395 @@
+#include "shm_queue.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+
+namespace{ //the layout of the shared memory, and the futexes
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "the futex words must be plain integers");
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "the positions are shared between processes, they can't use a lock");
+
+	constexpr uint32_t queue_magic = 0x51434d44; //"DMCQ"
+	constexpr uint32_t queue_version = 2;
+
+	/**
+	 * @brief The start of the shared memory; the slots follow it
+	 * @note the positions are on their own cache lines, so the producers and the consumer don't invalidate each other's
+	 */
+	struct QueueHeader{
+		std::atomic<uint32_t> magic; //written last, once the slots are ready
+		uint32_t version;
+		uint32_t slot_count;
+		uint32_t line_max;
+		uint32_t output_max;
+		uint32_t slot_size;
+		std::atomic<uint32_t> alive;
+		alignas(64) std::atomic<uint64_t> enqueue_pos;
+		alignas(64) std::atomic<uint32_t> consumer_sleeping;
+		std::atomic<uint32_t> consumer_wake; //futex word of the consumer
+	};
+
+	/**
+	 * @brief A slot, followed by its line (line_max + 1 bytes) and its output (output_max bytes)
+	 * @note the sequence of the slot at position pos tells its state: pos when it's free, pos + 1 when the line is ready,
+	 * pos + 2 when the result is ready, and pos + slot_count once the submitter has read it (free for the next lap).
+	 * A result not read for reclaim_ns is reclaimed by the next submitter of the slot: its submitter is gone
+	 */
+	struct alignas(64) SlotHeader{
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> finished_ns; //when the result was ready, on the monotonic clock
+		std::atomic<uint32_t> done; //futex word of the submitter
+		std::atomic<uint32_t> waiting; //the submitter sleeps on done
+		uint32_t line_size;
+		uint32_t output_size;
+		int32_t exit_code;
+		uint8_t failed;
+		uint8_t truncated;
+	};
+
+	constexpr size_t align64(size_t n){
+		return (n + 63) & ~size_t(63);
+	}
+
+	inline QueueHeader* header(void* memory){
+		return static_cast<QueueHeader*>(memory);
+	}
+	inline SlotHeader* slot(void* memory, uint64_t pos){
+		QueueHeader* h = header(memory);
+		return reinterpret_cast<SlotHeader*>(static_cast<char*>(memory) + align64(sizeof(QueueHeader)) + (pos & (h->slot_count - 1)) * h->slot_size);
+	}
+	inline char* line_of(SlotHeader* s){
+		return reinterpret_cast<char*>(s) + sizeof(SlotHeader);
+	}
+	inline char* output_of(SlotHeader* s, const QueueHeader* h){
+		return line_of(s) + h->line_max + 1;
+	}
+
+	/**
+	 * @brief sleep while the word is equal to the value (or until the timeout); the futex is shared between processes
+	 */
+	void futex_wait(std::atomic<uint32_t>& word, uint32_t value, const timespec* timeout){
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, timeout, nullptr, 0);
+	}
+	void futex_wake(std::atomic<uint32_t>& word, int count){
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+	}
+
+	inline void cpu_relax(){
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_ia32_pause();
+#endif
+	}
+
+	/**
+	 * @brief the spins before a wait goes to sleep, a submission usually completes in fewer
+	 * @note with a single CPU, the other side can't progress while we spin, so we sleep at once
+	 */
+	const int spin_count = std::thread::hardware_concurrency() > 1 ? 4000 : 1;
+
+	/**
+	 * @brief how long a result waits for its submitter before its slot is reclaimed
+	 */
+	constexpr uint64_t reclaim_ns = 5000000000ull;
+
+	inline uint64_t monotonic_ns(){
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return uint64_t(now.tv_sec) * 1000000000ull + uint64_t(now.tv_nsec);
+	}
+
+	/**
+	 * @brief The stream buffer writing the output of a line into its slot, cutting what doesn't fit
+	 */
+	class SlotBuffer : public std::streambuf{
+		public:
+			bool truncated = false;
+
+			SlotBuffer(char* begin, size_t size){
+				setp(begin, begin + size);
+			}
+			size_t written() const{
+				return pptr() - pbase();
+			}
+		protected:
+			int_type overflow(int_type c) override{
+				if(!traits_type::eq_int_type(c, traits_type::eof())){
+					truncated = true;
+				}
+				return traits_type::not_eof(c);
+			}
+			std::streamsize xsputn(const char* s, std::streamsize n) override{
+				std::streamsize room = epptr() - pptr();
+				if(n > room){
+					truncated = true;
+				}
+				std::streamsize chunk = std::min(n, room);
+				std::memcpy(pptr(), s, chunk);
+				pbump((int)chunk);
+				return n; //what is cut is dropped, the command doesn't see an error
+			}
+	};
+}
+
+namespace Command{ //Command::ShmQueue class implementation
+
+	ShmQueue::ShmQueue(CommandManager& _manager, const std::string& _name, size_t slots, size_t line_max, size_t output_max, mode_t mode)
+		: manager(_manager), name(_name){
+		size_t slot_count = 4;
+		while(slot_count < slots){
+			slot_count <<= 1;
+		}
+		const size_t slot_size = align64(sizeof(SlotHeader) + line_max + 1 + output_max);
+		if(slot_size > UINT32_MAX || slot_count > UINT32_MAX / 2){
+			throw CommandException("The shared memory queue '" + name + "' is too big.");
+		}
+		size = align64(sizeof(QueueHeader)) + slot_count * slot_size;
+
+		::shm_unlink(name.c_str()); //an object left by a previous run
+		int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+		if(fd < 0){
+			throw CommandException("The shared memory queue '" + name + "' could not be created: " + std::strerror(errno));
+		}
+		if(::fchmod(fd, mode) != 0 || ::ftruncate(fd, size) != 0){ //fchmod: the umask must not narrow the mode
+			int e = errno;
+			::close(fd);
+			::shm_unlink(name.c_str());
+			throw CommandException("The shared memory queue '" + name + "' could not be created: " + std::strerror(e));
+		}
+		memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(memory == MAP_FAILED){
+			memory = nullptr;
+			::shm_unlink(name.c_str());
+			throw CommandException("The shared memory queue '" + name + "' could not be mapped: " + std::strerror(errno));
+		}
+
+		QueueHeader* h = new(memory) QueueHeader();
+		h->version = queue_version;
+		h->slot_count = (uint32_t)slot_count;
+		h->line_max = (uint32_t)line_max;
+		h->output_max = (uint32_t)output_max;
+		h->slot_size = (uint32_t)slot_size;
+		h->alive.store(1, std::memory_order_relaxed);
+		h->enqueue_pos.store(0, std::memory_order_relaxed);
+		for(uint64_t pos = 0; pos < slot_count; ++pos){
+			SlotHeader* s = new(slot(memory, pos)) SlotHeader();
+			s->sequence.store(pos, std::memory_order_relaxed);
+		}
+		h->magic.store(queue_magic, std::memory_order_release); //the clients can attach from now on
+
+		consumer = std::thread(&ShmQueue::consume, this);
+	}
+
+	ShmQueue::~ShmQueue(){
+		stop();
+		::munmap(memory, size);
+		::shm_unlink(name.c_str());
+	}
+
+	void ShmQueue::stop(){
+		QueueHeader* h = header(memory);
+		h->alive.store(0, std::memory_order_seq_cst);
+		h->consumer_wake.fetch_add(1, std::memory_order_seq_cst);
+		futex_wake(h->consumer_wake, INT_MAX);
+		if(consumer.joinable()){
+			consumer.join();
+		}
+		for(uint64_t pos = 0; pos < h->slot_count; ++pos){ //the submitters waiting for a result notice that the queue is gone
+			SlotHeader* s = slot(memory, pos);
+			s->done.fetch_add(1, std::memory_order_seq_cst);
+			futex_wake(s->done, INT_MAX);
+		}
+	}
+
+	void ShmQueue::consume(){
+		QueueHeader* h = header(memory);
+		std::istream none(nullptr); //a submitted line has no input
+		for(uint64_t pos = 0; h->alive.load(std::memory_order_acquire);){
+			SlotHeader* s = slot(memory, pos);
+			int spins = 0;
+			while(s->sequence.load(std::memory_order_acquire) != pos + 1 && h->alive.load(std::memory_order_relaxed)){
+				if(++spins < spin_count){
+					cpu_relax();
+					continue;
+				}
+				//sleep, once the submitters know it: they check consumer_sleeping after publishing their line
+				uint32_t wake = h->consumer_wake.load(std::memory_order_acquire);
+				h->consumer_sleeping.store(1, std::memory_order_seq_cst);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if(s->sequence.load(std::memory_order_acquire) != pos + 1 && h->alive.load(std::memory_order_relaxed)){
+					futex_wait(h->consumer_wake, wake, nullptr);
+				}
+				h->consumer_sleeping.store(0, std::memory_order_relaxed);
+				spins = 0;
+			}
+			if(!h->alive.load(std::memory_order_acquire)){
+				break;
+			}
+
+			//the same as execute(const std::string&), with the output in the slot
+			SlotBuffer buffer(output_of(s, h), h->output_max);
+			std::ostream out(&buffer);
+			int code = EXIT_SUCCESS;
+			bool stop = false; //exit only ends the submission
+			CommandManager::Context ctx{&none, &out, &out, &code, &stop};
+			CommandManager::context = &ctx;
+			bool failed = false;
+			try{
+				//the size is bounded here: the clients can write anything in the slot, a terminator included
+				manager.execute(std::string(line_of(s), std::min<uint32_t>(s->line_size, h->line_max)));
+			}catch(CommandException& e){
+				out << e.what() << '\n';
+				failed = true;
+			}catch(std::exception& e){ //a submission must not take the consumer down
+				out << "Error: " << e.what() << '\n';
+				failed = true;
+			}
+			CommandManager::context = nullptr;
+			s->exit_code = failed && code == EXIT_SUCCESS ? EXIT_FAILURE : code;
+			s->failed = failed;
+			s->truncated = buffer.truncated;
+			s->output_size = (uint32_t)buffer.written();
+			s->finished_ns.store(monotonic_ns(), std::memory_order_relaxed);
+
+			s->sequence.store(pos + 2, std::memory_order_release);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(s->waiting.load(std::memory_order_relaxed)){
+				s->done.fetch_add(1, std::memory_order_release);
+				futex_wake(s->done, INT_MAX);
+			}
+			++pos;
+		}
+	}
+
+}
+
+namespace Command{ //Command::ShmClient class implementation
+
+	ShmClient::ShmClient(const std::string& name){
+		int fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+		if(fd < 0){
+			throw CommandException("The shared memory queue '" + name + "' could not be opened: " + std::strerror(errno));
+		}
+		struct stat st;
+		if(::fstat(fd, &st) != 0 || (size_t)st.st_size < align64(sizeof(QueueHeader))){
+			::close(fd);
+			throw CommandException("The shared memory object '" + name + "' is not a command queue.");
+		}
+		size = st.st_size;
+		memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(memory == MAP_FAILED){
+			memory = nullptr;
+			throw CommandException("The shared memory queue '" + name + "' could not be mapped: " + std::strerror(errno));
+		}
+		const QueueHeader* h = header(memory);
+		if(h->magic.load(std::memory_order_acquire) != queue_magic || h->version != queue_version
+			|| align64(sizeof(QueueHeader)) + (size_t)h->slot_count * h->slot_size > size){
+			::munmap(memory, size);
+			memory = nullptr;
+			throw CommandException("The shared memory object '" + name + "' is not a command queue.");
+		}
+	}
+
+	ShmClient::~ShmClient(){
+		if(memory != nullptr){
+			::munmap(memory, size);
+		}
+	}
+
+	ShmResult ShmClient::submit(std::string_view line){
+		QueueHeader* h = header(memory);
+		if(line.size() > h->line_max){
+			throw CommandException("The line is too long for the queue (more than " + std::to_string(h->line_max) + " bytes).");
+		}
+
+		//claim a slot: the one at enqueue_pos, if its submitter of the previous lap is done with it
+		uint64_t pos = h->enqueue_pos.load(std::memory_order_relaxed);
+		SlotHeader* s;
+		for(int spins = 0;;){
+			if(!h->alive.load(std::memory_order_relaxed)){
+				throw CommandException("The command queue is stopped.");
+			}
+			s = slot(memory, pos);
+			int64_t diff = (int64_t)(s->sequence.load(std::memory_order_acquire) - pos);
+			if(diff == 0){
+				if(h->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+					break;
+				}
+			}else if(diff < 0){ //full, wait for a slot
+				if(++spins < spin_count){
+					cpu_relax();
+				}else{
+					uint64_t unread = pos - h->slot_count + 2;
+					if(diff + h->slot_count == 2 && monotonic_ns() - s->finished_ns.load(std::memory_order_relaxed) > reclaim_ns){
+						//the result of the previous lap is not read: its submitter died while it waited, the slot is freed
+						s->sequence.compare_exchange_strong(unread, pos, std::memory_order_acq_rel);
+						continue;
+					}
+					timespec pause{0, 50000};
+					nanosleep(&pause, nullptr);
+				}
+				pos = h->enqueue_pos.load(std::memory_order_relaxed);
+			}else{ //another submitter took it
+				pos = h->enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		std::memcpy(line_of(s), line.data(), line.size());
+		line_of(s)[line.size()] = '\0';
+		s->line_size = (uint32_t)line.size();
+		s->sequence.store(pos + 1, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(h->consumer_sleeping.load(std::memory_order_relaxed)){ //the only syscall of a submission, when the consumer is idle
+			h->consumer_wake.fetch_add(1, std::memory_order_release);
+			futex_wake(h->consumer_wake, 1);
+		}
+
+		//wait for the result, spinning first
+		for(int spins = 0; s->sequence.load(std::memory_order_acquire) != pos + 2;){
+			if(s->sequence.load(std::memory_order_acquire) - pos > 2){
+				throw CommandException("The result of the line was not read in time, its slot was reclaimed.");
+			}
+			if(++spins < spin_count){
+				cpu_relax();
+				continue;
+			}
+			uint32_t done = s->done.load(std::memory_order_acquire);
+			s->waiting.store(1, std::memory_order_seq_cst);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(s->sequence.load(std::memory_order_acquire) == pos + 2){
+				break;
+			}
+			if(!h->alive.load(std::memory_order_acquire)){
+				s->waiting.store(0, std::memory_order_relaxed);
+				throw CommandException("The command queue is stopped.");
+			}
+			timespec timeout{0, 100000000}; //in case the process of the queue is gone without stopping it
+			futex_wait(s->done, done, &timeout);
+		}
+
+		ShmResult result;
+		result.exit_code = s->exit_code;
+		result.failed = s->failed;
+		result.truncated = s->truncated;
+		result.output.assign(output_of(s, h), std::min(s->output_size, h->output_max));
+		s->waiting.store(0, std::memory_order_relaxed);
+		uint64_t ready = pos + 2;
+		if(!s->sequence.compare_exchange_strong(ready, pos + h->slot_count, std::memory_order_acq_rel)){ //free for the next lap
+			throw CommandException("The result of the line was not read in time, its slot was reclaimed.");
+		}
+		return result;
+	}
+
+}
@@ -0,0 +1,133 @@
+#ifndef __shm_queue_hpp__
+#define __shm_queue_hpp__
+
+#ifndef __linux__
+#error "shm_queue.hpp requires Linux (the waits use futexes)"
+#endif
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <sys/types.h>
+
+#include "command.hpp"
+
+namespace Command{
+
+	/**
+	 * @brief The result of a line submitted through a shared memory queue
+	 */
+	struct ShmResult{
+		/**
+		 * @brief the exit code of the line, as set_exit_code() left it (EXIT_FAILURE if it threw)
+		 */
+		int exit_code = EXIT_SUCCESS;
+		/**
+		 * @brief true if the execution threw a CommandException, its message is at the end of the output
+		 */
+		bool failed = false;
+		/**
+		 * @brief true if the output didn't fit in its slot and was cut
+		 */
+		bool truncated = false;
+		/**
+		 * @brief what the line wrote on its output and error streams
+		 */
+		std::string output;
+	};
+
+	/**
+	 * @brief A queue in shared memory, through which other processes submit lines to a CommandManager
+	 * @note it's a bounded ring of slots; any number of processes submit (ShmClient), one thread of this process executes
+	 * each line as CommandManager::execute(const std::string&) would, and writes its result back into the slot
+	 * @note a submission doesn't make any syscall while the consumer is awake and the queue isn't full;
+	 * the futexes are only used to sleep and to wake up a sleeper
+	 * @note a slot is only free again once its submitter has read the result; a result left unread for 5 seconds (its submitter
+	 * died while it waited) is reclaimed by the next submitter of the slot, so the ring doesn't stay full
+	 *
+	 * Example:
+	 * @code
+	 * Command::ShmQueue queue(manager, "/daemon-commands"); //in the daemon
+	 *
+	 * Command::ShmClient client("/daemon-commands");        //in another process
+	 * Command::ShmResult result = client.submit("status");
+	 * @endcode
+	 */
+	class ShmQueue{
+		private:
+			CommandManager& manager;
+			/**
+			 * @brief The name of the shared memory object, removed when the queue is destroyed
+			 */
+			std::string name;
+			void* memory = nullptr;
+			size_t size = 0;
+			std::thread consumer;
+
+			/**
+			 * @brief execute the submitted lines, in order, until stop()
+			 */
+			void consume();
+
+		public:
+			/**
+			 * @brief Create the shared memory object and start the consumer thread
+			 * @param manager: the manager executing the lines
+			 * @param name: the name of the shared memory object (ex: "/daemon-commands"); an object already there is replaced
+			 * @param slots: the number of lines that can wait at once, rounded up to a power of 2 (at least 4)
+			 * @param line_max: the longest line that can be submitted
+			 * @param output_max: the longest output sent back, the rest is cut
+			 * @param mode: the permissions of the shared memory object, only its owner can submit by default
+			 * @throw CommandException if the shared memory can't be created
+			 */
+			ShmQueue(CommandManager& manager, const std::string& name, size_t slots = 64, size_t line_max = 4096, size_t output_max = 1 << 16, mode_t mode = 0600);
+			ShmQueue(const ShmQueue&) = delete;
+			ShmQueue& operator=(const ShmQueue&) = delete;
+			/**
+			 * @brief Stop the consumer and remove the shared memory object
+			 */
+			~ShmQueue();
+
+			/**
+			 * @brief stop executing the submitted lines; the submitters waiting for a result get an error
+			 */
+			void stop();
+
+			inline const std::string& getName() const { return name; }
+	};
+
+	/**
+	 * @brief The submitting side of a ShmQueue, in another process (or in the same one)
+	 * @note a ShmClient can be shared by several threads
+	 */
+	class ShmClient{
+		private:
+			void* memory = nullptr;
+			size_t size = 0;
+
+		public:
+			/**
+			 * @brief Map the shared memory object of a ShmQueue
+			 * @param name: the name given to the ShmQueue
+			 * @throw CommandException if it doesn't exist or is not a queue
+			 */
+			explicit ShmClient(const std::string& name);
+			ShmClient(const ShmClient&) = delete;
+			ShmClient& operator=(const ShmClient&) = delete;
+			~ShmClient();
+
+			/**
+			 * @brief submit a line and wait for its result
+			 * @param line: the line to execute
+			 * @return the exit code and the output of the line
+			 * @throw CommandException if the line is too long, if the queue was stopped, or if this process didn't read
+			 * the result in time (stopped for 5 seconds) and its slot was reclaimed
+			 * @note if the queue is full, it waits for a free slot
+			 */
+			ShmResult submit(std::string_view line);
+	};
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef __test_hpp__
+#define __test_hpp__
+
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A minimal test harness: each case runs in turn, a failed check is printed with its place and fails the case,
+ * and the program returns the number of failed cases
+ */
+namespace Test{
+
+	/**
+	 * @brief thrown by a failed check, it ends its case
+	 */
+	struct Failure{
+		std::string message;
+	};
+
+	class Suite{
+		private:
+			std::vector<std::pair<std::string, std::function<void()>>> cases;
+			std::string filter;
+
+		public:
+			/**
+			 * @brief read the options: --filter <text> only runs the cases whose name contains the text
+			 */
+			Suite(int argc, char** argv){
+				for(int i = 1; i + 1 < argc; i += 2){
+					if(std::strcmp(argv[i], "--filter") == 0){
+						filter = argv[i+1];
+					}
+				}
+			}
+
+			/**
+			 * @brief add a case
+			 */
+			void add(const std::string& name, std::function<void()> body){
+				cases.emplace_back(name, std::move(body));
+			}
+
+			/**
+			 * @brief run the cases
+			 * @return the number of failed cases
+			 */
+			int run() const{
+				int failed = 0, ran = 0;
+				for(const auto& c : cases){
+					if(!filter.empty() && c.first.find(filter) == std::string::npos){
+						continue;
+					}
+					++ran;
+					try{
+						c.second();
+						std::cerr << "ok      " << c.first << std::endl;
+					}catch(const Failure& f){
+						++failed;
+						std::cerr << "FAILED  " << c.first << ": " << f.message << std::endl;
+					}catch(const std::exception& e){
+						++failed;
+						std::cerr << "FAILED  " << c.first << ": unexpected exception: " << e.what() << std::endl;
+					}
+				}
+				std::cerr << ran - failed << "/" << ran << " passed" << std::endl;
+				return failed;
+			}
+	};
+
+	template<typename A, typename B>
+	void check_equal(const A& a, const B& b, const char* expression, const char* file, int line){
+		if(!(a == b)){
+			std::ostringstream message;
+			message << file << ":" << line << ": " << expression << "\n    got:      [" << a << "]\n    expected: [" << b << "]";
+			throw Failure{message.str()};
+		}
+	}
+}
+
+#define TEST_CHECK(condition) do{ if(!(condition)) throw ::Test::Failure{std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " #condition}; }while(0)
+#define TEST_EQUAL(a, b) ::Test::check_equal((a), (b), #a " == " #b, __FILE__, __LINE__)
+/**
+ * @brief check that a statement throws an exception of the given type
+ */
+#define TEST_THROWS(statement, type) do{ bool thrown = false; try{ statement; }catch(const type&){ thrown = true; } \
+	if(!thrown) throw ::Test::Failure{std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " #statement " doesn't throw " #type}; }while(0)
+
+#endif
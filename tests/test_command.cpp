@@ -0,0 +1,214 @@
+/**
+ * @brief Tests of the tokenizer of the command lines, of the registry of commands and of the background jobs
+ * @note build it next to the library, for example:
+ *     g++ -std=c++17 -I.. test_command.cpp ../command.cpp -o test_command -lpthread
+ *     ./test_command [--filter <text>]
+ */
+#include "command.hpp"
+#include "test.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace{
+	/**
+	 * @brief the words of a parsed line: the name, the arguments and the keyword arguments, each one between brackets
+	 */
+	std::string words(std::string_view line){
+		Command::InputView view(line);
+		std::string result = "[" + std::string(view.name()) + "]";
+		for(std::string_view arg : view.getArgs()){
+			result += " [" + std::string(arg) + "]";
+		}
+		for(const auto& kwarg : view.getKwargs()){
+			result += " [" + std::string(kwarg.first) + "=" + std::string(kwarg.second) + "]";
+		}
+		return result;
+	}
+
+	void tokenizer(Test::Suite& suite){
+		suite.add("words are separated by runs of spaces and tabs", []{
+			TEST_EQUAL(words("cmd a  b\t\tc "), "[cmd] [a] [b] [c]");
+			TEST_EQUAL(words("  cmd"), "[cmd]");
+			TEST_EQUAL(words(""), "[]");
+		});
+		suite.add("single quotes keep everything", []{
+			TEST_EQUAL(words("cmd 'a b' 'x\\\"y' '$z'"), "[cmd] [a b] [x\\\"y] [$z]");
+			TEST_EQUAL(words("cmd ''"), "[cmd] []");
+			TEST_EQUAL(words("cmd a'b c'd"), "[cmd] [ab cd]");
+		});
+		suite.add("double quotes keep everything but \\\" and \\\\", []{
+			TEST_EQUAL(words("cmd \"a b\" \"q\\\"q\" \"s\\\\s\" \"\\$x\""), "[cmd] [a b] [q\"q] [s\\s] [\\$x]");
+		});
+		suite.add("a backslash outside of quotes escapes the next character", []{
+			TEST_EQUAL(words("cmd a\\ b \\'c"), "[cmd] [a b] ['c]");
+		});
+		suite.add("an unquoted = makes a keyword argument", []{
+			TEST_EQUAL(words("cmd k=1 'x=y' k\\=2 q=\"a b\""), "[cmd] [x=y] [k=2] [k=1] [q=a b]");
+		});
+		suite.add("the separators of pipelines and jobs are found unquoted", []{
+			using Command::InputView;
+			TEST_EQUAL(InputView::find_unquoted("a | b", '|'), size_t(2));
+			TEST_EQUAL(InputView::find_unquoted("a\\|b", '|'), std::string_view::npos);
+			TEST_EQUAL(InputView::find_unquoted("'a|b' \"c|d\"", '|'), std::string_view::npos);
+		});
+		suite.add("a copied view looks at its own arena", []{
+			const std::string line = "cmd 'a b' k=\"c d\""; //the line outlives the views, the unescaped words are in the arena
+			Command::InputView copy;
+			{
+				Command::InputView view(line);
+				copy = view;
+			}
+			TEST_EQUAL(copy.getArgs().at(0), "a b");
+			TEST_EQUAL(copy["k"], "c d");
+		});
+	}
+
+	/**
+	 * @brief A command blocking until it's released, then using its members; it tells when it's destroyed
+	 */
+	class Hold : public Command::Command{
+		private:
+			std::string last;
+		public:
+			static std::mutex mutex;
+			static std::condition_variable changed;
+			static bool running, released;
+			static std::string finished;
+			static std::atomic<bool> destroyed;
+
+			Hold() : Command("hold", "blocks until it's released", "", "hold [n]"){
+				set_default_value("n", "0");
+			}
+			~Hold(){
+				destroyed = true;
+			}
+			void execute(const Kwargs& kwargs) override{
+				std::unique_lock<std::mutex> lock(mutex);
+				running = true;
+				changed.notify_all();
+				changed.wait(lock, []{ return released; });
+				last = kwargs.at("n");
+				finished = last;
+			}
+	};
+	std::mutex Hold::mutex;
+	std::condition_variable Hold::changed;
+	bool Hold::running = false, Hold::released = false;
+	std::string Hold::finished;
+	std::atomic<bool> Hold::destroyed{false};
+
+	class Nop : public Command::Command{
+		public:
+			explicit Nop(const std::string& name) : Command(name, "does nothing", "", name) {}
+			void execute(const Kwargs&) override {}
+	};
+
+	/**
+	 * @brief remove the held command from another thread while it runs, and check it's only deleted once it returned
+	 * @param run: runs "hold" on the manager
+	 */
+	template<typename F>
+	void remove_while_running(F run){
+		std::istringstream in;
+		std::ostringstream out;
+		Command::CommandManager manager("test", in, out, out);
+		manager.addCommand(new Hold());
+		Hold::running = Hold::released = false;
+		Hold::finished.clear();
+		Hold::destroyed = false;
+		std::thread runner([&]{ run(manager); });
+		{
+			std::unique_lock<std::mutex> lock(Hold::mutex);
+			Hold::changed.wait(lock, []{ return Hold::running; });
+		}
+		manager.removeCommand("hold", [](Command::Command* c){ delete c; });
+		manager.addCommand(new Nop("later")); //a later modification releases what nobody runs anymore
+		TEST_CHECK(!Hold::destroyed);
+		{
+			std::lock_guard<std::mutex> lock(Hold::mutex);
+			Hold::released = true;
+		}
+		Hold::changed.notify_all();
+		runner.join();
+		manager.addCommand(new Nop("after"));
+		TEST_CHECK(Hold::destroyed);
+		TEST_EQUAL(Hold::finished, "1");
+	}
+
+	void registry(Test::Suite& suite){
+		suite.add("a command removed while execute() runs it", []{
+			remove_while_running([](Command::CommandManager& manager){ manager.execute("hold 1"); });
+		});
+		suite.add("a command removed while try_execute() runs it", []{
+			remove_while_running([](Command::CommandManager& manager){ manager.try_execute("hold 1"); });
+		});
+		suite.add("removed and added commands", []{
+			std::istringstream in;
+			std::ostringstream out;
+			Command::CommandManager manager("test", in, out, out);
+			manager.addCommand(new Nop("a"));
+			TEST_CHECK(manager.try_execute("a").ok());
+			manager.removeCommand("a", [](Command::Command* c){ delete c; });
+			TEST_CHECK(!manager.try_execute("a").ok());
+			manager.addCommand(new Nop("a"));
+			TEST_CHECK(manager.try_execute("a").ok());
+		});
+	}
+
+	void jobs(Test::Suite& suite){
+		suite.add("two jobs waiting for each other", []{
+			for(size_t threads : {1, 2, 4}){
+				std::istringstream in;
+				std::ostringstream out;
+				Command::CommandManager manager("test", in, out, out);
+				manager.enableJobs(threads);
+				manager.execute("wait &");
+				manager.execute("wait &");
+				manager.execute("wait"); //it returns: if they both wait for the other one, one of them refuses
+				manager.flush();
+				const std::string output = out.str();
+				TEST_CHECK(output.find("[1] Done\twait\n") != std::string::npos || output.find("[1] Failed (1)\twait\n") != std::string::npos);
+				TEST_CHECK(output.find("[2] Done\twait\n") != std::string::npos || output.find("[2] Failed (1)\twait\n") != std::string::npos);
+			}
+		});
+		suite.add("a job is finished once", []{
+			std::istringstream in;
+			std::ostringstream out;
+			Command::CommandManager manager("test", in, out, out);
+			manager.addCommand(new Nop("nop"));
+			manager.enableJobs(4);
+			for(int round = 0; round < 100; ++round){
+				const size_t id = manager.submit("nop");
+				std::thread waiter([&]{
+					try{
+						manager.waitJob(id);
+					}catch(const Command::CommandException&){ //already finished by another thread
+					}
+				});
+				std::thread all([&]{ manager.waitJobs(); });
+				manager.reportJobs();
+				waiter.join();
+				all.join();
+			}
+			manager.flush();
+			const std::string output = out.str();
+			size_t done = 0;
+			for(size_t i = output.find("Done"); i != std::string::npos; i = output.find("Done", i + 1)){
+				++done;
+			}
+			TEST_EQUAL(done, size_t(100));
+		});
+	}
+}
+
+int main(int argc, char** argv){
+	Test::Suite suite(argc, argv);
+	tokenizer(suite);
+	registry(suite);
+	jobs(suite);
+	return suite.run();
+}
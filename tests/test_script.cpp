@@ -0,0 +1,259 @@
+/**
+ * @brief Tests of the scripts: the control lines, the substitution of the variables, the errors and the cache of compiled scripts
+ * @note build it next to the library, for example:
+ *     g++ -std=c++17 -I.. test_script.cpp ../command.cpp -o test_script -lpthread
+ *     ./test_script [--filter <text>]
+ */
+#include "command.hpp"
+#include "test.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+namespace{
+	namespace fs = std::filesystem;
+
+	/**
+	 * @brief A command printing its arguments between brackets, to see how they were split
+	 */
+	class Say : public Command::Command{
+		public:
+			explicit Say(const std::string& name = "say") : Command(name, "prints its arguments", "", name + " <text> [more]"){
+				set_default_value("more", "-");
+			}
+			void execute(const Kwargs& kwargs) override{
+				output() << name << " [" << kwargs.at("text") << "] [" << kwargs.at("more") << "]\n";
+			}
+	};
+
+	/**
+	 * @brief A command named like a keyword of the scripts
+	 */
+	class Set : public Command::Command{
+		public:
+			Set() : Command("set", "a command named set", "", "set [v]"){
+				set_default_value("v", "-");
+			}
+			void execute(const Kwargs& kwargs) override{
+				output() << "set command [" << kwargs.at("v") << "]\n";
+			}
+	};
+
+	/**
+	 * @brief A command removing itself when it runs, then using its members
+	 */
+	class Once : public Command::Command{
+		private:
+			std::string last;
+		public:
+			Once() : Command("once", "removes itself", "", "once <n>") {}
+			void execute(const Kwargs& kwargs) override{
+				output() << name << " " << kwargs.at("n") << "\n";
+				master->removeCommand(this, [](Command* c){ delete c; });
+				last = kwargs.at("n"); //still alive: it's released once no thread runs it
+			}
+	};
+
+	/**
+	 * @brief A manager writing into a string, and the directory of the scripts of a case
+	 */
+	class Fixture{
+		public:
+			std::istringstream in;
+			std::ostringstream out;
+			Command::CommandManager manager;
+			fs::path directory;
+
+			Fixture() : manager("test", in, out, out){
+				directory = fs::temp_directory_path() / ("command_test_script_" + std::to_string(::getpid()));
+				fs::remove_all(directory);
+				fs::create_directories(directory);
+				manager.addCommand(new Say());
+			}
+			~Fixture(){
+				std::error_code error;
+				fs::remove_all(directory, error);
+			}
+
+			fs::path write(const std::string& name, const std::string& text){
+				const fs::path path = directory / name;
+				std::ofstream(path, std::ios::binary) << text;
+				return path;
+			}
+
+			/**
+			 * @brief run a script
+			 * @return what it printed, followed by "error: <message>" if it threw
+			 */
+			std::string run(const fs::path& path){
+				out.str("");
+				try{
+					manager.execute_script(path);
+				}catch(const Command::CommandException& e){
+					manager.flush();
+					out << "error: " << e.what();
+				}
+				manager.flush();
+				return out.str();
+			}
+			std::string run_text(const std::string& text){
+				return run(write("script.txt", text));
+			}
+	};
+
+	void control_flow(Test::Suite& suite){
+		suite.add("for from to, continue", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("set n=3\nfor i from 1 to $n\n\tif $i == 2\n\t\tcontinue\n\tend\n\tsay $i\nend\n"),
+				"say [1] [-]\nsay [3] [-]\n");
+		});
+		suite.add("for in, nested loops and break", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("for i in a 'b c'\n\tfor j in 1 2 3\n\t\tif $j == 3\n\t\t\tbreak\n\t\tend\n\t\tsay $i$j\n\tend\nend\n"),
+				"say [a1] [-]\nsay [a2] [-]\nsay [b c1] [-]\nsay [b c2] [-]\n");
+		});
+		suite.add("while and arithmetic", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("set i=0\nwhile $i < 10\n\tset i=$i + 3\n\tif $i > 6\n\t\tbreak\n\tend\n\tsay $i\nend\nset m=$i % 4\nsay $i more=$m\n"),
+				"say [3] [-]\nsay [6] [-]\nsay [9] [1]\n");
+		});
+		suite.add("if, else if, else and not", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("set a=b\nif $a == a\n\tsay A\nelse if $a == b\n\tsay B\nelse\n\tsay C\nend\nif not $a\n\tsay no\nelse\n\tsay yes\nend\n"),
+				"say [B] [-]\nsay [yes] [-]\n");
+		});
+		suite.add("integers are compared as numbers", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("if 10 > 9\n\tsay numbers\nend\nif b > a\n\tsay texts\nend\n"), "say [numbers] [-]\nsay [texts] [-]\n");
+		});
+	}
+
+	void substitution(Test::Suite& suite){
+		suite.add("a value is one argument", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("set msg='hello world'\nsay $msg\nsay ${msg}s more=$msg\n"),
+				"say [hello world] [-]\nsay [hello worlds] [hello world]\n");
+		});
+		suite.add("an empty value is an empty argument", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("set e=\nsay $e x\nsay x more=$e\n"), "say [] [x]\nsay [x] []\n");
+		});
+		suite.add("single quotes and escapes keep the $", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("set msg=hi\nsay '$msg' \\$msg\nsay \"a $msg\" more=$HOME\n"),
+				"say [$msg] [$msg]\nsay [a hi] [$HOME]\n");
+		});
+		suite.add("the text path gives the same arguments as the bound path", []{
+			Fixture f;
+			f.manager.registerFactory("lazy", "a lazy say", []{ return new Say("lazy"); });
+			const std::string lines = "say $msg\nsay $e x\nsay \"[$q]\" more=$q\nsay '$msg'\n";
+			std::string lazy_lines = lines;
+			for(size_t i = lazy_lines.find("say"); i != std::string::npos; i = lazy_lines.find("say", i + 4)){
+				lazy_lines.replace(i, 3, "lazy");
+			}
+			const std::string head = "set msg='hello world'\nset e=\nset q=\"it's \\\"q\\\" a\\\\b=c|d\"\n";
+			std::string bound = f.run_text(head + lines), text = f.run_text(head + lazy_lines);
+			for(size_t i = text.find("lazy"); i != std::string::npos; i = text.find("lazy", i + 3)){
+				text.replace(i, 4, "say");
+			}
+			TEST_EQUAL(text, bound);
+			TEST_EQUAL(bound, "say [hello world] [-]\nsay [] [x]\nsay [[it's \"q\" a\\b=c|d]] [it's \"q\" a\\b=c|d]\nsay [$msg] [-]\n");
+		});
+		suite.add("a pipeline gets the values escaped", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("set msg='a b'\nsay x | say $msg\n"), "say [a b] [-]\n");
+		});
+	}
+
+	void keywords_and_errors(Test::Suite& suite){
+		suite.add("a registered command takes the place of a keyword", []{
+			Fixture f;
+			TEST_EQUAL(f.run_text("set v=1\nsay $v\n"), "say [1] [-]\n");
+			f.manager.addCommand(new Set());
+			TEST_EQUAL(f.run_text("set v=1\n'set' v=2\nsay done\n"), "set command [1]\nset command [2]\nsay [done] [-]\n");
+		});
+		suite.add("an invalid control line stops the script before it starts", []{
+			Fixture f;
+			const fs::path path = f.write("bad.txt", "say before\nif 1\n\tsay x\n");
+			TEST_EQUAL(f.run(path), "error: " + path.string() + ":2: 'if' is not closed by 'end'.");
+		});
+		suite.add("the first failing line stops the script", []{
+			Fixture f;
+			const fs::path path = f.write("failing.txt", "say a\nset z=1 / 0\nsay never\n");
+			TEST_EQUAL(f.run(path), "say [a] [-]\nerror: " + path.string() + ":2: Division by zero.");
+		});
+		suite.add("a missing script", []{
+			Fixture f;
+			TEST_THROWS(f.manager.execute_script(f.directory / "none.txt"), Command::CommandException);
+		});
+		suite.add("a command removing itself while a script runs it", []{
+			Fixture f;
+			f.manager.addCommand(new Once());
+			TEST_EQUAL(f.run_text("once 1\n"), "once 1\n");
+			f.manager.addCommand(new Say("other")); //a later modification releases the command
+			f.manager.addCommand(new Once());
+			const std::string output = f.run_text("once 2\nonce 3\n");
+			TEST_CHECK(output.rfind("once 2\nerror: ", 0) == 0);
+		});
+	}
+
+	void cache(Test::Suite& suite){
+		suite.add("a cached script runs as the compiled one", []{
+			Fixture f;
+			f.manager.enableScriptCache(f.directory / "cache");
+			const std::string text = "set n=2\nfor i from 1 to $n\n\tsay $i more=\"$i $i\"\nend\nsay x | say y\n";
+			const std::string expected = "say [1] [1 1]\nsay [2] [2 2]\nsay [y] [-]\n";
+			TEST_EQUAL(f.run_text(text), expected);
+			TEST_EQUAL(std::distance(fs::directory_iterator(f.directory / "cache"), fs::directory_iterator()), 1);
+			TEST_EQUAL(f.run_text(text), expected);
+		});
+		suite.add("a cache hit doesn't read the script again", []{
+			Fixture f;
+			f.manager.enableScriptCache(f.directory / "cache");
+			const fs::path path = f.write("hit.txt", "say aaa\n");
+			TEST_EQUAL(f.run(path), "say [aaa] [-]\n");
+			//the same size and modification time: the key of the cache doesn't change, the compiled script is used
+			const fs::file_time_type time = fs::last_write_time(path);
+			f.write("hit.txt", "say bbb\n");
+			fs::last_write_time(path, time);
+			TEST_EQUAL(f.run(path), "say [aaa] [-]\n");
+		});
+		suite.add("a changed script or changed commands compile it again", []{
+			Fixture f;
+			f.manager.enableScriptCache(f.directory / "cache");
+			const fs::path path = f.write("miss.txt", "say a\nset v=1\n");
+			TEST_EQUAL(f.run(path), "say [a] [-]\n");
+			f.write("miss.txt", "say bb\nset v=1\n");
+			TEST_EQUAL(f.run(path), "say [bb] [-]\n");
+			f.manager.addCommand(new Set());
+			TEST_EQUAL(f.run(path), "say [bb] [-]\nset command [1]\n");
+		});
+		suite.add("a damaged cache is compiled again", []{
+			Fixture f;
+			const fs::path cache = f.directory / "cache";
+			f.manager.enableScriptCache(cache);
+			const fs::path path = f.write("damaged.txt", "for i in 1 2\n\tsay $i\nend\n");
+			const std::string expected = "say [1] [-]\nsay [2] [-]\n";
+			TEST_EQUAL(f.run(path), expected);
+			for(const fs::directory_entry& entry : fs::directory_iterator(cache)){
+				std::fstream file(entry.path(), std::ios::in | std::ios::out | std::ios::binary);
+				file.seekp(std::streamoff(fs::file_size(entry.path()) / 2));
+				file << "garbage";
+			}
+			TEST_EQUAL(f.run(path), expected);
+			TEST_EQUAL(f.run(path), expected);
+		});
+	}
+}
+
+int main(int argc, char** argv){
+	Test::Suite suite(argc, argv);
+	control_flow(suite);
+	substitution(suite);
+	keywords_and_errors(suite);
+	cache(suite);
+	return suite.run();
+}
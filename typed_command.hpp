@@ -0,0 +1,438 @@
+#ifndef __typed_command_hpp__
+#define __typed_command_hpp__
+
+#if __cplusplus < 202002L
+#error "typed_command.hpp requires C++20 (the usage string is a template argument)"
+#endif
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "command.hpp"
+
+namespace Command{
+
+	/**
+	 * @brief A string literal usable as a template argument
+	 */
+	template<size_t N>
+	struct FixedString{
+		char data[N] = {};
+
+		constexpr FixedString(const char (&s)[N]){
+			for(size_t i = 0; i < N; ++i){
+				data[i] = s[i];
+			}
+		}
+
+		constexpr std::string_view view() const { return std::string_view(data, N - 1); }
+	};
+
+	namespace Typed{
+
+		/**
+		 * @brief The type of an argument, as written after the ':' in the usage
+		 */
+		enum class ArgType{
+			String,
+			Int,
+			Long,
+			UInt,
+			ULong,
+			Double,
+			Float,
+			Bool
+		};
+
+		/**
+		 * @brief An argument of a typed usage
+		 */
+		struct ArgSpec{
+			std::string_view name;
+			ArgType type = ArgType::String;
+			bool optional = false;
+			bool variadic = false;
+			bool has_default = false;
+			std::string_view default_value;
+		};
+
+		/**
+		 * @brief What is wrong with a typed usage, checked by TypedCommand with a static_assert per kind
+		 */
+		enum class UsageError{
+			None,
+			NoName,
+			Unbalanced,
+			EmptyArgName,
+			UnknownType,
+			Duplicate,
+			TooMany,
+			DefaultOnRequired,
+			BadDefault,
+			VariadicNotLast
+		};
+
+		/**
+		 * @brief A typed usage parsed at compile time
+		 * @tparam N: the size of the usage string, the stripped usage can't be longer
+		 */
+		template<size_t N>
+		struct Usage{
+			std::string_view command;
+			std::array<ArgSpec, Command::max_args> args{};
+			size_t count = 0;
+			UsageError error = UsageError::None;
+			/**
+			 * @brief the usage without the types and the defaults, as Command::parse_usage() reads it (ex: "name <count> [ratio]")
+			 */
+			char stripped[N] = {};
+			size_t stripped_size = 0;
+
+			constexpr std::string_view strippedView() const { return std::string_view(stripped, stripped_size); }
+		};
+
+		constexpr bool is_space(char c){
+			return c == ' ' || c == '\t';
+		}
+
+		constexpr bool parse_type(std::string_view t, ArgType& type){
+			if(t == "string" || t == "str"){ type = ArgType::String; return true; }
+			if(t == "int"){ type = ArgType::Int; return true; }
+			if(t == "long"){ type = ArgType::Long; return true; }
+			if(t == "uint" || t == "unsigned"){ type = ArgType::UInt; return true; }
+			if(t == "ulong"){ type = ArgType::ULong; return true; }
+			if(t == "double"){ type = ArgType::Double; return true; }
+			if(t == "float"){ type = ArgType::Float; return true; }
+			if(t == "bool"){ type = ArgType::Bool; return true; }
+			return false;
+		}
+
+		/**
+		 * @brief the words accepted for a bool, true ones first
+		 */
+		inline constexpr std::array<std::string_view, 8> bool_words = {"true", "yes", "on", "1", "false", "no", "off", "0"};
+
+		/**
+		 * @brief the position of a character, as std::string_view::find (which GCC can't evaluate on a template argument)
+		 */
+		constexpr size_t find(std::string_view s, char c){
+			for(size_t i = 0; i < s.size(); ++i){
+				if(s[i] == c) return i;
+			}
+			return std::string_view::npos;
+		}
+
+		constexpr bool is_digit(char c){
+			return c >= '0' && c <= '9';
+		}
+
+		/**
+		 * @brief check that a default value can be converted to the type of its argument
+		 */
+		constexpr bool valid_default(std::string_view v, ArgType type){
+			size_t i = 0;
+			switch(type){
+				case ArgType::String:
+					return true;
+				case ArgType::Bool:
+					for(std::string_view w : bool_words){
+						if(w == v) return true;
+					}
+					return false;
+				case ArgType::Int:
+				case ArgType::Long:
+					if(i < v.size() && v[i] == '-') ++i;
+					[[fallthrough]];
+				case ArgType::UInt:
+				case ArgType::ULong:
+					if(i == v.size()) return false;
+					for(; i < v.size(); ++i){
+						if(!is_digit(v[i])) return false;
+					}
+					return true;
+				case ArgType::Double:
+				case ArgType::Float:{
+					if(i < v.size() && v[i] == '-') ++i;
+					size_t digits = 0;
+					for(; i < v.size() && is_digit(v[i]); ++i) ++digits;
+					if(i < v.size() && v[i] == '.'){
+						for(++i; i < v.size() && is_digit(v[i]); ++i) ++digits;
+					}
+					if(digits == 0) return false;
+					if(i < v.size() && (v[i] == 'e' || v[i] == 'E')){
+						++i;
+						if(i < v.size() && (v[i] == '-' || v[i] == '+')) ++i;
+						if(i == v.size() || !is_digit(v[i])) return false;
+						while(i < v.size() && is_digit(v[i])) ++i;
+					}
+					return i == v.size();
+				}
+			}
+			return false;
+		}
+
+		/**
+		 * @brief parse a typed usage (ex: "name <count:int> [ratio:double=0.5] [args...]")
+		 * @note an argument without a type is a string; only an optional argument can have a default value
+		 */
+		template<size_t N>
+		constexpr Usage<N> parse(std::string_view s){
+			Usage<N> u;
+			auto append = [&u](std::string_view part){
+				for(char c : part){
+					u.stripped[u.stripped_size++] = c;
+				}
+			};
+
+			size_t i = 0;
+			while(i < s.size() && is_space(s[i])) ++i;
+			size_t start = i;
+			while(i < s.size() && !is_space(s[i])) ++i;
+			u.command = s.substr(start, i - start);
+			if(u.command.empty() || u.command[0] == '<' || u.command[0] == '['){
+				u.error = UsageError::NoName;
+				return u;
+			}
+			append(u.command);
+
+			while(true){
+				while(i < s.size() && is_space(s[i])) ++i;
+				if(i == s.size()) break;
+
+				const char open = s[i];
+				if(open != '<' && open != '['){
+					u.error = UsageError::Unbalanced;
+					return u;
+				}
+				const char close = open == '<' ? '>' : ']';
+				start = ++i;
+				while(i < s.size() && s[i] != close && s[i] != '<' && s[i] != '[' && s[i] != '>' && s[i] != ']' && !is_space(s[i])) ++i;
+				if(i == s.size() || s[i] != close){
+					u.error = UsageError::Unbalanced;
+					return u;
+				}
+				std::string_view body = s.substr(start, i - start);
+				++i;
+				if(i < s.size() && !is_space(s[i])){
+					u.error = UsageError::Unbalanced;
+					return u;
+				}
+
+				if(u.count == Command::max_args){
+					u.error = UsageError::TooMany;
+					return u;
+				}
+				if(u.count > 0 && u.args[u.count - 1].variadic){
+					u.error = UsageError::VariadicNotLast;
+					return u;
+				}
+
+				ArgSpec arg;
+				arg.optional = open == '[';
+				if(body == "args..."){
+					if(!arg.optional){
+						u.error = UsageError::UnknownType;
+						return u;
+					}
+					arg.name = body;
+					arg.variadic = true;
+				}else{
+					size_t eq = find(body, '=');
+					if(eq != std::string_view::npos){
+						if(!arg.optional){
+							u.error = UsageError::DefaultOnRequired;
+							return u;
+						}
+						arg.has_default = true;
+						arg.default_value = body.substr(eq + 1);
+						body = body.substr(0, eq);
+					}
+					size_t colon = find(body, ':');
+					arg.name = body.substr(0, colon);
+					if(colon != std::string_view::npos && !parse_type(body.substr(colon + 1), arg.type)){
+						u.error = UsageError::UnknownType;
+						return u;
+					}
+					if(arg.has_default && !valid_default(arg.default_value, arg.type)){
+						u.error = UsageError::BadDefault;
+						return u;
+					}
+				}
+				if(arg.name.empty()){
+					u.error = UsageError::EmptyArgName;
+					return u;
+				}
+				for(size_t j = 0; j < u.count; ++j){
+					if(u.args[j].name == arg.name){
+						u.error = UsageError::Duplicate;
+						return u;
+					}
+				}
+
+				append(" ");
+				append(arg.optional ? "[" : "<");
+				append(arg.name);
+				append(arg.optional ? "]" : ">");
+				u.args[u.count++] = arg;
+			}
+			return u;
+		}
+
+		template<ArgType T> struct type_of;
+		template<> struct type_of<ArgType::String>{ using type = std::string; };
+		template<> struct type_of<ArgType::Int>{ using type = int; };
+		template<> struct type_of<ArgType::Long>{ using type = long long; };
+		template<> struct type_of<ArgType::UInt>{ using type = unsigned int; };
+		template<> struct type_of<ArgType::ULong>{ using type = unsigned long long; };
+		template<> struct type_of<ArgType::Double>{ using type = double; };
+		template<> struct type_of<ArgType::Float>{ using type = float; };
+		template<> struct type_of<ArgType::Bool>{ using type = bool; };
+
+		/**
+		 * @brief the name of a type, for the conversion errors
+		 */
+		constexpr std::string_view type_name(ArgType type){
+			switch(type){
+				case ArgType::String: return "a string";
+				case ArgType::Int: return "an int";
+				case ArgType::Long: return "a long";
+				case ArgType::UInt: return "an unsigned int";
+				case ArgType::ULong: return "an unsigned long";
+				case ArgType::Double: return "a double";
+				case ArgType::Float: return "a float";
+				case ArgType::Bool: return "a bool";
+			}
+			return "";
+		}
+
+		/**
+		 * @brief convert the value of an argument
+		 * @return false if the value is not a valid T
+		 */
+		template<typename T>
+		bool convert(std::string_view value, T& out){
+			if constexpr(std::is_same_v<T, std::string>){
+				out.assign(value);
+				return true;
+			}else if constexpr(std::is_same_v<T, bool>){
+				for(size_t i = 0; i < bool_words.size(); ++i){
+					if(bool_words[i] == value){
+						out = i < bool_words.size() / 2;
+						return true;
+					}
+				}
+				return false;
+			}else{
+				const char* first = value.data();
+				const char* last = first + value.size();
+				if(first != last && *first == '+') ++first; //from_chars doesn't accept it
+				auto [end, ec] = std::from_chars(first, last, out);
+				return ec == std::errc() && end == last && first != last;
+			}
+		}
+	}
+
+	/**
+	 * @brief A command whose usage is parsed at compile time, and whose arguments are converted to their type before the execution
+	 * @tparam Spec: the typed usage (ex: "count <n:int> [ratio:double=0.5] [label]")
+	 * @note the types are string (or str), int, long, uint (or unsigned), ulong, double, float and bool; an argument without a type is a string
+	 * @note an optional argument without a default value is value-initialized when it's not given; a conversion failure throws a CommandException
+	 * @note the usage must not be changed with setUsage(), the arguments would not match the types anymore
+	 *
+	 * Example:
+	 * @code
+	 * class Repeat : public Command::TypedCommand<"repeat <text> [count:int=2]">{
+	 * 	public:
+	 * 		Repeat() : TypedCommand("Repeats a text") {}
+	 * 		void execute(const Args& args) override {
+	 * 			for(int i = 0; i < std::get<1>(args); ++i) output() << std::get<0>(args) << std::endl;
+	 * 		}
+	 * };
+	 * @endcode
+	 */
+	template<FixedString Spec>
+	class TypedCommand : public Command{
+		private:
+			static constexpr Typed::Usage<sizeof(Spec.data)> spec = Typed::parse<sizeof(Spec.data)>(Spec.view());
+
+			static_assert(spec.error != Typed::UsageError::NoName, "typed usage: the usage must start with the command name");
+			static_assert(spec.error != Typed::UsageError::Unbalanced, "typed usage: each argument must be enclosed in <> or [] and separated by spaces");
+			static_assert(spec.error != Typed::UsageError::EmptyArgName, "typed usage: an argument has no name");
+			static_assert(spec.error != Typed::UsageError::UnknownType, "typed usage: unknown argument type (string, int, long, uint, ulong, double, float or bool)");
+			static_assert(spec.error != Typed::UsageError::Duplicate, "typed usage: two arguments have the same name");
+			static_assert(spec.error != Typed::UsageError::TooMany, "typed usage: too many arguments (see Command::max_args)");
+			static_assert(spec.error != Typed::UsageError::DefaultOnRequired, "typed usage: only an optional argument can have a default value");
+			static_assert(spec.error != Typed::UsageError::BadDefault, "typed usage: a default value doesn't match the type of its argument");
+			static_assert(spec.error != Typed::UsageError::VariadicNotLast, "typed usage: [args...] must be the last argument");
+
+			template<size_t... I>
+			static auto make_args(std::index_sequence<I...>) -> std::tuple<typename Typed::type_of<spec.args[I].type>::type...>;
+
+		public:
+			/**
+			 * @brief The typed arguments, in the order of the usage
+			 */
+			using Args = decltype(make_args(std::make_index_sequence<spec.count>()));
+
+			/**
+			 * @brief Construct a typed command
+			 * @param description: A string containing a short description of the command
+			 * @param long_desc: A string containing a long description of the command, it will be split on '\\n' characters
+			 */
+			TypedCommand(const std::string& description, const std::string& long_desc = "")
+				: Command(std::string(spec.command), description, long_desc, std::string(spec.strippedView())){
+				for(size_t i = 0; i < spec.count; ++i){
+					if(spec.args[i].has_default){
+						set_default_value(std::string(spec.args[i].name), std::string(spec.args[i].default_value));
+					}
+				}
+			}
+
+			/**
+			 * @brief execute the command with its converted arguments
+			 */
+			virtual void execute(const Args& args) = 0;
+
+			void execute(const Kwargs& kwargs) final{
+				Values values;
+				for(size_t i = 0; i < spec.count; ++i){
+					auto it = kwargs.find(args_ordered[i]);
+					if(it != kwargs.end()){
+						values[i] = it->second;
+					}
+				}
+				execute_bound(values);
+			}
+
+		protected:
+			void execute_bound(const Values& values) final{
+				Args args;
+				convert_all(values, args, std::make_index_sequence<spec.count>());
+				execute(args);
+			}
+
+		private:
+			template<size_t... I>
+			void convert_all(const Values& values, Args& args, std::index_sequence<I...>) const{
+				(convert_one<I>(values[I], std::get<I>(args)), ...);
+			}
+
+			template<size_t I, typename T>
+			void convert_one(std::string_view value, T& out) const{
+				if(value.empty() && spec.args[I].optional){
+					return; //not given and without a default value
+				}
+				if(!Typed::convert(value, out)){
+					throw CommandException("Command '" + name + "' argument '" + std::string(spec.args[I].name) + "' must be " + std::string(Typed::type_name(spec.args[I].type)) + ", got '" + std::string(value) + "'.");
+				}
+			}
+	};
+}
+
+#endif